@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include "brokerArena.h"
+#include "type.h"
+#include "util.h"
+#include "zAllocator.h"
+
+// compile-time description of one side of the book
+//  better(lhs, rhs): lhs has higher price priority than rhs
+//  skWorstPrice: sentinel of best price when the side is empty
+//  skOpposite: side an incoming order of this side matches against
+//  skMarketPrice: limit of a market order of this side, it crosses every price of the opposite side
+//  but not its skWorstPrice sentinel
+//  crosses(limit, price): an incoming order of this side limited at limit matches a level at price
+template <QuoteType kSide>
+struct SideTraits;
+
+template <>
+struct SideTraits<QuoteType::Buy> {
+    using CompareT = std::greater<Price>;
+    static constexpr Price skWorstPrice = std::numeric_limits<Price>::min();
+    static constexpr QuoteType skOpposite = QuoteType::Sell;
+    static constexpr Price skMarketPrice = std::numeric_limits<Price>::max() - 1;
+    ForceInline static constexpr bool better(Price lhs, Price rhs) { return lhs > rhs; }
+    ForceInline static constexpr bool crosses(Price limit, Price price) { return price <= limit; }
+};
+
+template <>
+struct SideTraits<QuoteType::Sell> {
+    using CompareT = std::less<Price>;
+    static constexpr Price skWorstPrice = std::numeric_limits<Price>::max();
+    static constexpr QuoteType skOpposite = QuoteType::Buy;
+    static constexpr Price skMarketPrice = std::numeric_limits<Price>::min() + 1;
+    ForceInline static constexpr bool better(Price lhs, Price rhs) { return lhs < rhs; }
+    ForceInline static constexpr bool crosses(Price limit, Price price) { return price >= limit; }
+};
+
+// a book side maps price to level value, ordered by price priority.
+// every backend (see MapBook, LadderBook, BTreeBook) provides the same interface:
+//  SideT(BrokerArena &): memory of the side comes from the arena of its broker
+//  reset(): empty side, after BrokerArena::reset
+//  empty() / size()
+//  bestPrice(): best price, SideTraits::skWorstPrice when empty
+//  best(): value of the best level, side must not be empty
+//  popBest(): remove the best level
+//  find(price): pointer to the value or nullptr
+//  emplace(price, value): {pointer to value, inserted}, like std::map::emplace
+//  erase(price)
+//  forEach(fn): visit levels from the best, fn(price, value) returns false to stop
+//  prefetch(price): hint that the level at price is accessed soon, may do nothing
+template <QuoteType kSide, class ValueT, template <class> class AllocT = zAllocator>
+struct MapBookSide {
+    using TraitsT = SideTraits<kSide>;
+    using AllocatorT = AllocT<std::pair<const Price, ValueT>>;
+    using MapT = std::map<Price, ValueT, typename TraitsT::CompareT, AllocatorT>;
+    static constexpr bool skArenaAllocated = std::is_constructible_v<AllocatorT, BrokerArena *>;
+
+    explicit MapBookSide(BrokerArena &arena) requires skArenaAllocated : levels_(AllocatorT(&arena)) {}
+    explicit MapBookSide(BrokerArena &) requires(!skArenaAllocated) {}
+    MapBookSide(MapBookSide &&) = delete;
+    MapBookSide(const MapBookSide &) = delete;
+    MapBookSide &operator=(MapBookSide &&) = delete;
+    MapBookSide &operator=(const MapBookSide &) = delete;
+
+    ForceInline bool empty() const { return levels_.empty(); }
+    ForceInline size_t size() const { return levels_.size(); }
+
+    void reset() {
+        if constexpr (skArenaAllocated) {
+            // the nodes went back with the arena, the tree starts over without visiting them
+            std::construct_at(&levels_, levels_.get_allocator());
+        } else {
+            levels_.clear();
+        }
+    }
+
+    ForceInline Price bestPrice() const {
+        return levels_.empty() ? TraitsT::skWorstPrice : levels_.begin()->first;
+    }
+    ForceInline ValueT &best() { return levels_.begin()->second; }
+    ForceInline void popBest() { levels_.erase(levels_.begin()); }
+
+    // a tree node is only found by walking the tree
+    ForceInline void prefetch(Price) const {}
+
+    inline ValueT *find(Price price) {
+        auto it = levels_.find(price);
+        return (it != levels_.end()) ? &(it->second) : nullptr;
+    }
+
+    inline std::pair<ValueT *, bool> emplace(Price price, const ValueT &value) {
+        auto result = levels_.emplace(price, value);
+        return {&(result.first->second), result.second};
+    }
+
+    inline void erase(Price price) { levels_.erase(price); }
+
+    template <class F>
+    void forEach(F &&fn) const {
+        for (auto it = levels_.begin(); it != levels_.end(); it++) {
+            if (!fn(it->first, it->second)) {
+                return;
+            }
+        }
+    }
+
+   private:
+    MapT levels_;
+};
+
+// red-black tree backend, std::map with nodes from AllocT
+template <template <class> class AllocT>
+struct MapBookWith {
+    template <QuoteType kSide, class ValueT>
+    using SideT = MapBookSide<kSide, ValueT, AllocT>;
+};
+
+// nodes from the arena of the broker, see MapBookWith<zAllocator> for a FlatPool per tree
+using MapBook = MapBookWith<ArenaAllocator>;
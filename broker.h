@@ -2,320 +2,769 @@
 
 #include <cstdint>
 #include <cstring>
-#include <functional>
-#include <limits>
-#include <map>
 #include <memory>
+#include <span>
 #include <utility>
-#include "floatOp.h"
+#include "bookSide.h"
+#include "brokerArena.h"
+#include "brokerMetrics.h"
+#include "depthIndex.h"
+#include "eventSink.h"
+#include "flatPool.h"
+#include "hotOrder.h"
+#include "levelQueue.h"
 #include "message.h"
+#include "orderIndex.h"
+#include "perfCounters.h"
+#include "preTradeRisk.h"
+#include "seqlockBook.h"
+#include "sideTable.h"
+#include "tickScale.h"
+#include "topLevels.h"
 #include "tscClock.h"
-#include "zAllocator.h"
+
+// what becomes of the qty of a market order left at its protection bound
+enum class MarketRemainder : uint8_t { Cancel = 0, Limit = 1 };
+
+// price protection of the market orders of one instrument (a broker matches one symbol, see BrokerRegistry):
+// a market order sweeps at most bandBps_ basis points through the opposite best price it arrives at,
+// rounded up to whole ticks and at least one tick (see bandTicks), 0 leaves it unbounded. the remaining qty is
+// canceled, or with Limit rests as a limit order at the bound unless the order is IOC or FOK. that limit order
+// is checked by RiskT like an incoming one
+struct MarketProtection {
+    int64_t bandBps_ = 0;
+    MarketRemainder remainder_ = MarketRemainder::Cancel;
+};
 
 // not thread safe
-struct Broker {
-    // todo: instead of std::map with absl::btree_map
-    using BidsT = std::map<Price, Qty, std::greater<Price>, zAllocator<std::pair<const Price, Qty>>>;
-    using AsksT = std::map<Price, Qty, std::less<Price>, zAllocator<std::pair<const Price, Qty>>>;
+// BookT selects the price level container of both sides, see MapBook, LadderBook and BTreeBook
+// SinkT receives trades and order state transitions, see NullSink and EventRing
+// kBookDepth best levels of each side are maintained incrementally for getOrderBook/getOrderBookDelta
+// MetricsT counts orders and fill sweeps, see NullMetrics and BrokerMetrics
+// RiskT checks every incoming order before it is matched, see NullRisk and PreTradeRisk
+template <class BookT = MapBook, class SinkT = NullSink, uint32_t kBookDepth = 10, class MetricsT = NullMetrics,
+          class RiskT = NullRisk>
+struct BrokerT {
+    // each level is a FIFO of resting orders, levels and orders come from FlatPool.
+    // every container takes its memory from the BrokerArena of the broker.
+    // orders are matched on their HotOrder fields, wire orders are converted on the way in
+    using BidsT = typename BookT::template SideT<QuoteType::Buy, LevelQueue *>;
+    using AsksT = typename BookT::template SideT<QuoteType::Sell, LevelQueue *>;
+
+    static constexpr uint32_t skBookDepth = kBookDepth;
+    static constexpr uint32_t skDefaultMaxOrders = 1 << 18;
+    // orders ahead of the current one in a batch whose level and index slot are prefetched
+    static constexpr size_t skPrefetchDistance = 4;
+
+    // arena mapped beyond the orders for tree nodes and the first level chunk, grown when needed
+    static constexpr size_t skArenaSlack = 8 << 20;
+
+    // maxOrders bounds the resting orders, the order index is sized for it up front.
+    // config backs the arena and the order index, pages are faulted on first touch by default, see ArenaConfig.
+    // depthTicks is the window of the FOK depth index of each side, sized to the price range of the
+    // instrument, see DepthIndex
+    explicit BrokerT(uint32_t maxOrders = skDefaultMaxOrders, const ArenaConfig &config = BrokerArena::skOnDemand,
+                     uint32_t depthTicks = DepthIndex<QuoteType::Buy>::skDefaultLevels)
+        : arena_(arenaSize(maxOrders), config),
+          bids_(arena_),
+          asks_(arena_),
+          bidDepth_(arena_, depthTicks),
+          askDepth_(arena_, depthTicks),
+          levelPool_(&arena_),
+          orderPool_(&arena_),
+          index_(maxOrders, config),
+          orderQty_(arena_) {}
+    BrokerT(BrokerT &&) = delete;
+    BrokerT(const BrokerT &) = delete;
+    BrokerT &operator=(BrokerT &&) = delete;
+    BrokerT &operator=(const BrokerT &) = delete;
+
+    SinkT &sink() { return sink_; }
+    RiskT &risk() { return risk_; }
+
+    void setMarketProtection(const MarketProtection &protection) { protection_ = protection; }
+    const MarketProtection &marketProtection() const { return protection_; }
+
+    // carve the pools for orders resting orders and levels price levels from the arena up front and fault
+    // them in, so the first burst takes no page fault, huge pages and mlock are up to the arena config
+    void reserve(uint32_t orders, uint32_t levels) {
+        orderPool_.reserve(orders);
+        levelPool_.reserve(levels);
+    }
+
+    // bring the reserved pools back into the tlb and caches, e.g. right before the session opens
+    void warmup() const {
+        orderPool_.warmup();
+        levelPool_.warmup();
+    }
+
+    // drop every order and level in place, e.g. between replays or sessions: the arena is rewound in O(1)
+    // and keeps its faulted memory, no container is freed node by node. the order index starts a new epoch
+    // in O(1), the depth windows forget their pages, the ladder bitmap is cleared, the sink and metrics are
+    // left as they are, risk forgets the open orders
+    void reset() {
+        arena_.reset();
+        bestBidPrice_ = BidsT::TraitsT::skWorstPrice;
+        bids_.reset();
+        bestAskPrice_ = AsksT::TraitsT::skWorstPrice;
+        asks_.reset();
+        bidDepth_.reset();
+        askDepth_.reset();
+        levelPool_.reset();
+        orderPool_.reset();
+        index_.reset();
+        orderQty_.reset();
+        risk_.onReset();
+        reconcileTop();
+        seqNum_ = tradeId_ = 0;
+    }
 
-    Broker() = default;
-    Broker(Broker &&) = delete;
-    Broker(const Broker &) = delete;
-    Broker &operator=(Broker &&) = delete;
-    Broker &operator=(const Broker &) = delete;
+#ifdef TOB_PERF_COUNTERS
+    // counters of insertOrder, cancelOrder and getOrderBook are added to profile, nullptr stops it
+    void setPerfProfile(PerfProfile *profile) { perfProfile_ = profile; }
+#endif
 
+    // the wire order is matched on its hot fields, see toHot
     HintHot void insertOrder(const Order &order) {
-        /*  lookup table avoid switch case, for performance but useless for readability
-            and actually it's invalid for performance improvement, need to verify again
-
-            using MemFuncT = void (Broker::*)(const Order &);
-            static constexpr int32_t kFunNum = 4;
-            static constexpr MemFuncT FuncTab[kFunNum] = {&Broker::onLimitBuyOrder, &Broker::onLimitSellOrder,
-                                                        &Broker::onMarketBuyOrder, &Broker::onMarketSellOrder};
-            const int32_t funcIndex = ((order.type_ > OrderType::Limit) << 1) | (order.side_ > QuoteType::Buy);
-            MemFuncT func = FuncTab[funcIndex];
-            return (this->*func)(order);
-        */
-
-        switch (order.type_) {
-            case OrderType::Limit: {
-                switch (order.side_) {
-                    case QuoteType::Buy:
-                        return onLimitBuyOrder(order);
-
-                    case QuoteType::Sell:
-                        return onLimitSellOrder(order);
-
-                    default:
-                        break;
-                }
+        HotOrder hot;
+        toHot(order, hot);
+        insertOrder(hot);
+    }
 
-                case OrderType::Market: {
-                    switch (order.side_) {
-                        case QuoteType::Buy:
-                            return onMarketBuyOrder(order);
+    HintHot void insertOrder(const HotOrder &order) {
+        TOB_PERF_SCOPE(perfProfile_, InsertOrder);
+        metrics_.onInsert();
+        // a coid already resting is rejected before it can trade, against that very order too
+        if (index_.find(order.coid_)) [[unlikely]] {
+            return reportOrder(order.coid_, order.side_, OrderStatus::Rejected, order.price_, 0, order.remainQty_);
+        }
+        if (!risk_.check(order, bestBidPrice_, bestAskPrice_)) [[unlikely]] {
+            return reportOrder(order.coid_, order.side_, OrderStatus::Rejected, order.price_, 0, order.remainQty_);
+        }
+        dispatchOrder(order);
+    }
 
-                        case QuoteType::Sell:
-                            return onMarketSellOrder(order);
+    // an order rejected ahead of the broker, e.g. by the risk stage of a Pipeline, is reported in sequence
+    // with the events of the orders matched before it
+    void rejectOrder(const Order &order) {
+        reportOrder(order.coid_, order.side_, OrderStatus::Rejected, order.price_, 0, order.remainQty_);
+    }
 
-                        default:
-                            break;
-                    }
-                }
+    // same events and book as insertOrder on each order in turn, the levels and index slots of
+    // upcoming orders are prefetched and the best levels for getOrderBook are reconciled once per batch
+    HintHot void insertOrders(std::span<const Order> orders) { insertBatch(orders); }
+    HintHot void insertOrders(std::span<const HotOrder> orders) { insertBatch(orders); }
 
-                default:
-                    break;
-            }
+    bool cancelOrder(const Order &order) {
+        if (order.orderStatus_ != OrderStatus::Canceled) {
+            return false;
         }
+        // market orders never rest so they are not found
+        return cancelOrder(order.coid_);
     }
 
-    void cancelOrder(const Order &order) {
-        if (order.orderStatus_ != OrderStatus::Canceled) {
-            return;
+    // a single probe of the order index, the resting order carries its level and the level its side
+    bool cancelOrder(uint64_t coid) {
+        TOB_PERF_SCOPE(perfProfile_, CancelOrder);
+        if (!cancelResting(coid)) {
+            return false;
         }
+        bestBidPrice_ = bids_.bestPrice();
+        bestAskPrice_ = asks_.bestPrice();
+        return true;
+    }
 
-        switch (order.type_) {
-            case OrderType::Limit: {
-                switch (order.side_) {
-                    case QuoteType::Buy:
-                        return onCancelLimitBuyOrder(order);
+    // same events and book as cancelOrder on each coid in turn, return the number of canceled orders.
+    // cancels never match so best prices and best levels are reconciled once per batch
+    HintHot size_t cancelOrders(std::span<const uint64_t> coids) {
+        const size_t constSize = coids.size();
+        for (size_t i = 0; i < constSize && i < skPrefetchDistance; i++) {
+            index_.prefetch(coids[i]);
+        }
 
-                    case QuoteType::Sell:
-                        return onCancelLimitSellOrder(order);
+        size_t canceled = 0;
+        topDeferred_ = true;
+        for (size_t i = 0; i < constSize; i++) {
+            if (i + skPrefetchDistance < constSize) [[likely]] {
+                index_.prefetch(coids[i + skPrefetchDistance]);
+            }
+            canceled += cancelResting(coids[i]);
+        }
+        bestBidPrice_ = bids_.bestPrice();
+        bestAskPrice_ = asks_.bestPrice();
+        reconcileTop();
+        return canceled;
+    }
 
-                    default:
-                        break;
-                }
-                // ignore market order
+    // amend price and total qty of a resting order, filled qty is kept so the new remaining
+    // qty is qty - filled, the order is canceled when nothing remains.
+    //  same price and lower remaining qty: reduced in place, queue position kept
+    //  same price and higher remaining qty: moved to the tail of its level
+    //  new price: one unlink from the old level and one link at the tail of the new level,
+    //  a new price crossing the opposite side is matched like an incoming limit order
+    // an amend adding qty or moving the price goes through risk first, a rejected one is reported and
+    // leaves the resting order as it was. return false when the order is not resting or rejected
+    bool amendOrder(uint64_t coid, Price price, Qty qty) {
+        RestingOrder *resting = index_.find(coid);
+        if (!resting) {
+            return false;
+        }
+
+        const Qty remainQty = qty - (orderQty_.at(orderPool_.handle(resting)) - resting->remainQty_);
+        if (remainQty <= 0) {
+            return cancelOrder(coid);
+        }
+
+        const LevelQueue &levelRef = levelPool_[resting->level_];
+        if (price != levelRef.price_ || remainQty > resting->remainQty_) {
+            HotOrder amended;
+            amended.coid_ = coid;
+            amended.side_ = levelRef.side_;
+            amended.price_ = price;
+            amended.qty_ = qty;
+            amended.remainQty_ = remainQty;
+            if (!risk_.checkAmend(amended, remainQty - resting->remainQty_, bestBidPrice_, bestAskPrice_))
+                [[unlikely]] {
+                reportOrder(coid, levelRef.side_, OrderStatus::Rejected, price, 0, remainQty);
+                return false;
             }
+        }
 
-            default:
-                break;
+        if (levelRef.side_ == QuoteType::Buy) {
+            amendResting(bids_, bestBidPrice_, bestAskPrice_, resting, price, qty, remainQty);
+        } else {
+            amendResting(asks_, bestAskPrice_, bestBidPrice_, resting, price, qty, remainQty);
         }
+        return true;
     }
 
+    // copied from the incrementally maintained best levels when DEPTH <= kBookDepth
     template <size_t DEPTH>
     void getOrderBook(Orderbook<DEPTH> &obRef, size_t depth = DEPTH) const {
-        size_t i = 0;
+        TOB_PERF_SCOPE(perfProfile_, GetOrderBook);
         const size_t constMaxDepth = (depth > DEPTH) ? DEPTH : depth;
-        for (auto it = bids_.begin(); it != bids_.end() && i < constMaxDepth; it++) {
-            PriceLevel &priceLevelRef = obRef.bid(i++);
-            priceLevelRef.price_ = it->first;
-            priceLevelRef.qty_ = it->second;
+        if (constMaxDepth <= kBookDepth) [[likely]] {
+            topBids_.refill(bids_);
+            topAsks_.refill(asks_);
+            obRef.bidSize_ = topBids_.copyTo(obRef.bids_, constMaxDepth);
+            obRef.askSize_ = topAsks_.copyTo(obRef.asks_, constMaxDepth);
+            return;
         }
+
+        size_t i = 0;
+        bids_.forEach([&](Price price, const LevelQueue *level) {
+            if (i >= constMaxDepth) {
+                return false;
+            }
+            PriceLevel &priceLevelRef = obRef.bid(i++);
+            priceLevelRef.price_ = price;
+            priceLevelRef.qty_ = level->qty_;
+            return true;
+        });
         obRef.bidSize_ = i;
 
         i = 0;
-        for (auto it = asks_.begin(); it != asks_.end() && i < constMaxDepth; it++) {
+        asks_.forEach([&](Price price, const LevelQueue *level) {
+            if (i >= constMaxDepth) {
+                return false;
+            }
             PriceLevel &priceLevelRef = obRef.ask(i++);
-            priceLevelRef.price_ = it->first;
-            priceLevelRef.qty_ = it->second;
-        }
+            priceLevelRef.price_ = price;
+            priceLevelRef.qty_ = level->qty_;
+            return true;
+        });
         obRef.askSize_ = i;
     }
 
+    // levels changed since the previous delta, applying it to the previous snapshot gives the current one
+    void getOrderBookDelta(OrderbookDelta<kBookDepth> &deltaRef) {
+        topBids_.refill(bids_);
+        topAsks_.refill(asks_);
+
+        uint16_t i = 0;
+        topBids_.drainDirty([&](uint32_t rank, const PriceLevel &level) {
+            PriceLevelUpdate &updateRef = deltaRef.updates_[i++];
+            updateRef.side_ = QuoteType::Buy;
+            updateRef.rank_ = rank;
+            updateRef.level_ = level;
+        });
+        topAsks_.drainDirty([&](uint32_t rank, const PriceLevel &level) {
+            PriceLevelUpdate &updateRef = deltaRef.updates_[i++];
+            updateRef.side_ = QuoteType::Sell;
+            updateRef.rank_ = rank;
+            updateRef.level_ = level;
+        });
+        deltaRef.updateSize_ = i;
+        deltaRef.bidSize_ = topBids_.size();
+        deltaRef.askSize_ = topAsks_.size();
+    }
+
+    // publish the best levels to concurrent readers, nothing is written when they did not change since the
+    // previous publish, return whether a book was published
+    template <size_t DEPTH>
+    bool publishOrderBook(SeqlockBook<DEPTH> &bookRef) {
+        static_assert(DEPTH <= kBookDepth, "only the incrementally maintained levels are published");
+        topBids_.refill(bids_);
+        topAsks_.refill(asks_);
+        const uint64_t constVersion = topBids_.version() + topAsks_.version();
+        if (constVersion == publishedVersion_) [[likely]] {
+            return false;
+        }
+
+        publishedVersion_ = constVersion;
+        bookRef.publish([&](Orderbook<DEPTH> &obRef) {
+            obRef.bidSize_ = topBids_.copyTo(obRef.bids_, DEPTH);
+            obRef.askSize_ = topAsks_.copyTo(obRef.asks_, DEPTH);
+        });
+        return true;
+    }
+
+    // counters of MetricsT (0 with NullMetrics) and the current state of the book and pools,
+    // from the matching thread, see ShmMetricsWriter to export it
+    void metrics(BrokerMetricsSnapshot &snapshotRef) const {
+        metrics_.copyTo(snapshotRef);
+        snapshotRef.bidLevels_ = bids_.size();
+        snapshotRef.askLevels_ = asks_.size();
+        snapshotRef.bidQty_ = bidDepth_.total();
+        snapshotRef.askQty_ = askDepth_.total();
+        snapshotRef.restingOrders_ = index_.size();
+        poolMetrics(levelPool_, snapshotRef.levelPool_);
+        poolMetrics(orderPool_, snapshotRef.orderPool_);
+    }
+
    private:
-    HintHot void onLimitBuyOrder(const Order &buyOrder) {
-        Qty remainQty = buyOrder.remainQty_;
-        const bool shouldBeMatch = !lessThan(buyOrder.price_, bestAskPrice_);
-        if (shouldBeMatch) [[likely]] {
-            for (auto it = asks_.begin(); it != asks_.upper_bound(buyOrder.price_);) {
-                if (it->second > remainQty) [[likely]] {
-                    bestAskPrice_ = it->first;
-                    it->second -= remainQty;
-                    remainQty = 0;
-                    break;
-                } else {
-                    remainQty -= it->second;
-                    it = asks_.erase(it);
-                }
-            }
+    template <class OrderT>
+    HintHot void insertBatch(std::span<const OrderT> orders) {
+        const size_t constSize = orders.size();
+        for (size_t i = 0; i < constSize && i < skPrefetchDistance; i++) {
+            prefetchOrder(orders[i]);
+        }
 
-            if (asks_.empty()) [[unlikely]] {
-                bestAskPrice_ = std::numeric_limits<Price>::max();
+        topDeferred_ = true;
+        for (size_t i = 0; i < constSize; i++) {
+            if (i + skPrefetchDistance < constSize) [[likely]] {
+                prefetchOrder(orders[i + skPrefetchDistance]);
             }
+            insertOrder(orders[i]);
         }
+        reconcileTop();
+    }
 
-        // consider that time priority including GTC/FOK/IOC,
-        // only GTC&FAK order be handled here
-        if (remainQty) {
-            updateBids(buyOrder, remainQty);
-        }
+    template <class PoolT>
+    static void poolMetrics(const PoolT &pool, PoolMetrics &metricsRef) {
+        metricsRef.highWaterMark_ = pool.highWaterMark();
+        metricsRef.freeListLength_ = pool.freeListLength();
+        metricsRef.chunkCount_ = pool.chunkCount();
     }
 
-    void onCancelLimitBuyOrder(const Order &buyOrder) {
-        // at first, should determine whether the entry exist in order book
-        // order should be stored in hashmap
-        Qty remainQty = buyOrder.remainQty_;
-        auto it = bids_.find(buyOrder.price_);
-        if (it != bids_.end()) {
-            if (it->second > remainQty) [[likely]] {
-                it->second -= remainQty;
+    template <class OrderT>
+    ForceInline void prefetchOrder(const OrderT &order) const {
+        index_.prefetch(order.coid_);
+        if (order.type_ == OrderType::Limit) [[likely]] {
+            if (order.side_ == QuoteType::Buy) {
+                bids_.prefetch(order.price_);
             } else {
-                it = bids_.erase(it);
-                updateBestBidPrice(it, buyOrder.price_);
+                asks_.prefetch(order.price_);
             }
         }
     }
 
-    HintHot void onLimitSellOrder(const Order &sellOrder) {
-        Qty remainQty = sellOrder.remainQty_;
-        const bool shouldBeMatch = !greator(sellOrder.price_, bestBidPrice_);
-        if (shouldBeMatch) [[likely]] {
-            for (auto it = bids_.begin(); it != bids_.upper_bound(sellOrder.price_);) {
-                if (it->second > remainQty) [[likely]] {
-                    bestBidPrice_ = it->first;
-                    it->second -= remainQty;
-                    remainQty = 0;
-                    break;
-                } else {
-                    remainQty -= it->second;
-                    it = bids_.erase(it);
-                }
-            }
-
-            if (bids_.empty()) [[unlikely]] {
-                bestBidPrice_ = std::numeric_limits<Price>::min();
-            }
+    // best prices are left stale, the caller refreshes them
+    HintHot bool cancelResting(uint64_t coid) {
+        RestingOrder *resting = index_.erase(coid);
+        metrics_.onCancel(resting != nullptr);
+        if (!resting) {
+            return false;
         }
 
-        // consider that time priority including GTC/FOK/IOC,
-        // only GTC&FAK order be handled here
-        if (remainQty) {
-            updateAsks(sellOrder, remainQty);
+        const LevelQueue &levelRef = levelPool_[resting->level_];
+        reportOrder(resting->coid_, levelRef.side_, OrderStatus::Canceled, levelRef.price_, 0, resting->remainQty_);
+        if (levelRef.side_ == QuoteType::Buy) {
+            removeResting(bids_, resting);
+        } else {
+            removeResting(asks_, resting);
         }
+        return true;
     }
 
-    void onCancelLimitSellOrder(const Order &sellOrder) {
-        // at first, should determine whether the entry exist in order book
-        Qty remainQty = sellOrder.remainQty_;
-        auto it = asks_.find(sellOrder.price_);
-        if (it != asks_.end()) {
-            if (it->second > remainQty) [[likely]] {
-                it->second -= remainQty;
-            } else {
-                it = asks_.erase(it);
-                updateBestAskPrice(it, sellOrder.price_);
-            }
-        }
+    // slot of (type, side) in the kernel table of insertOrder, 2 bits each
+    static constexpr uint32_t skKernelCount = 16;
+    ForceInline static constexpr uint32_t kernelIndex(OrderType type, QuoteType side) {
+        return ((static_cast<uint32_t>(type) & 3) << 2) | (static_cast<uint32_t>(side) & 3);
     }
 
-    // Futures contracts for market orders to be limited to 1% worse than the best bid or ask
-    // protect traders from things like slippage and “fat finger trade” (trader mistakes).
-    void onMarketBuyOrder(const Order &buyOrder) {
-        Qty remainQty = buyOrder.remainQty_;
-        const bool shouldBeMatch = lessThan(buyOrder.price_, bestAskPrice_);
-        if (shouldBeMatch) [[likely]] {
-            for (auto it = asks_.begin(); it != asks_.end();) {
-                if (it->second > remainQty) [[likely]] {
-                    bestAskPrice_ = it->first;
-                    it->second -= remainQty;
-                    remainQty = 0;
-                    break;
-                } else {
-                    // when filled qty hit 1% of total limit order qty should give up fill
-                    remainQty -= it->second;
-                    it = asks_.erase(it);
-                }
-            }
+    // one indirect call instead of nested switches, unknown types and sides are ignored
+    HintHot void dispatchOrder(const HotOrder &order) {
+        using KernelT = void (BrokerT::*)(const HotOrder &);
+        static constexpr KernelT skKernels[skKernelCount] = {
+            &BrokerT::ignoreOrder, &BrokerT::ignoreOrder, &BrokerT::ignoreOrder, &BrokerT::ignoreOrder,
+            &BrokerT::ignoreOrder, &BrokerT::matchOrder<OrderType::Limit, QuoteType::Buy>,
+            &BrokerT::matchOrder<OrderType::Limit, QuoteType::Sell>, &BrokerT::ignoreOrder,
+            &BrokerT::ignoreOrder, &BrokerT::matchOrder<OrderType::Market, QuoteType::Buy>,
+            &BrokerT::matchOrder<OrderType::Market, QuoteType::Sell>, &BrokerT::ignoreOrder,
+            &BrokerT::ignoreOrder, &BrokerT::ignoreOrder, &BrokerT::ignoreOrder, &BrokerT::ignoreOrder};
+        static_assert(kernelIndex(OrderType::Limit, QuoteType::Buy) == 5 &&
+                          kernelIndex(OrderType::Market, QuoteType::Sell) == 10,
+                      "skKernels is laid out by kernelIndex");
+        return (this->*skKernels[kernelIndex(order.type_, order.side_)])(order);
+    }
 
-            if (asks_.empty()) [[unlikely]] {
-                bestAskPrice_ = std::numeric_limits<Price>::max();
-            }
+    void ignoreOrder(const HotOrder &) {}
+
+    // the matching kernel of every order type and side: the incoming order sweeps the opposite side
+    // in price then time priority while its limit crosses the best level. the limit of a market order is
+    // its protection bound, computed once from the opposite best price (see marketLimit), so the sweep
+    // is the bounded one of limit orders and a thin book is not swept to its end.
+    // GTC (and Unknown) limit orders rest the remaining qty, IOC cancels it, a FOK order passing the
+    // check is filled, the remaining qty of a market order is canceled or rested at its bound,
+    // see MarketProtection
+    template <OrderType kType, QuoteType kSide>
+    HintHot void matchOrder(const HotOrder &order) {
+        using TraitsT = SideTraits<kSide>;
+        constexpr bool constMarket = (kType == OrderType::Market);
+        auto &oppositeRef = bookOf<TraitsT::skOpposite>();
+        Price &oppositeBestRef = bestPriceOf<TraitsT::skOpposite>();
+        const Price constLimit = constMarket ? marketLimit<kSide>() : order.price_;
+
+        Qty remainQty = order.remainQty_;
+        if (order.tif_ == TimeInForce::FOK && !fillable<kType, kSide>(order, constLimit)) [[unlikely]] {
+            return reportOrder(order.coid_, kSide, OrderStatus::Canceled, order.price_, 0, remainQty);
         }
 
-        // transfer market order into limit order
-        // when filled qty hit 1% of total limit order qty
-        // time priority of market order should be IOC
-        // so remainQty must be cancelled or
-        // transfer market order into limit order
-        // do not send orderRsp and trade to trader
-        // remainQty of marketOrder great than 0 is impossible
-        // risk control should handle this
-    }
-
-    // Futures contracts for market orders to be limited
-    // to 1% worse than the best bid or ask
-    // protect traders from things like slippage
-    // and “fat finger trade” (trader mistakes).
-    void onMarketSellOrder(const Order &sellOrder) {
-        Qty remainQty = sellOrder.remainQty_;
-        const bool shouldBeMatch = !greator(sellOrder.price_, bestBidPrice_);
-        if (shouldBeMatch) [[likely]] {
-            for (auto it = bids_.begin(); it != bids_.end();) {
-                if (it->second > remainQty) [[likely]] {
-                    bestBidPrice_ = it->first;
-                    it->second -= remainQty;
-                    remainQty = 0;
-                    break;
-                } else {
-                    // when filled qty hit 1% of total limit order qty should give up fill
-                    remainQty -= it->second;
-                    it = bids_.erase(it);
+        if (TraitsT::crosses(constLimit, oppositeBestRef)) [[likely]] {
+            // bestPrice() of an empty side is the worst price sentinel which stops the loop
+            while (remainQty && TraitsT::crosses(constLimit, oppositeRef.bestPrice())) {
+                LevelQueue *level = oppositeRef.best();
+                metrics_.onLevelSwept();
+                const Qty constTakerQty = remainQty;
+                remainQty = fillLevel(*level, order, remainQty);
+                onLevel(oppositeRef, *level, remainQty - constTakerQty);
+                if (level->empty()) {
+                    oppositeRef.popBest();
+                    levelPool_.deallocate(level);
                 }
             }
+            oppositeBestRef = oppositeRef.bestPrice();
+            metrics_.onSweepEnd();
+        }
 
-            if (bids_.empty()) [[unlikely]] {
-                bestBidPrice_ = std::numeric_limits<Price>::min();
+        if (remainQty) {
+            if (constMarket || isImmediate(order.tif_)) [[unlikely]] {
+                if (constMarket && protection_.remainder_ == MarketRemainder::Limit && !isImmediate(order.tif_) &&
+                    constLimit != TraitsT::skMarketPrice) {
+                    return restAtBound<kSide>(order, constLimit, remainQty);
+                }
+                reportOrder(order.coid_, kSide, OrderStatus::Canceled, order.price_, 0, remainQty);
+            } else {
+                const bool newLevel = restOrder(bookOf<kSide>(), order, remainQty);
+                Price &bestRef = bestPriceOf<kSide>();
+                if (newLevel && TraitsT::better(order.price_, bestRef)) {
+                    bestRef = order.price_;
+                }
             }
         }
+    }
 
-        // transfer market order into limit order
-        // when filled qty hit 1% of total limit order qty
-        // time priority of market order should be IOC
-        // so remainQty must be cancelled
-        // or transfer market order into limit order
-        // do not send orderRsp and trade to trader
-        // remainQty of marketOrder great than 0 is impossible
-        // risk control should handle this
+    // limit of a market order: bandBps_ through the opposite best price, or SideTraits::skMarketPrice
+    // sweeping the whole side when the order is unprotected or the opposite side is empty
+    template <QuoteType kSide>
+    ForceInline Price marketLimit() {
+        constexpr QuoteType constOpposite = SideTraits<kSide>::skOpposite;
+        const Price constBest = bestPriceOf<constOpposite>();
+        if (!protection_.bandBps_ || constBest == SideTraits<constOpposite>::skWorstPrice) {
+            return SideTraits<kSide>::skMarketPrice;
+        }
+        const Price constBand = bandTicks(constBest, protection_.bandBps_);
+        return (kSide == QuoteType::Buy) ? constBest + constBand : constBest - constBand;
     }
 
-    inline void updateBestBidPrice(BidsT::iterator &it, Price price) {
-        if (!bids_.empty()) [[likely]] {
-            if (equal(price, bestBidPrice_)) [[unlikely]] {
-                bestBidPrice_ = it->first;
+    // the remaining qty of a protected market order becomes a limit order at its bound, keeping the coid.
+    // risk passed the market order without the checks of resting orders, so the limit order goes through
+    // risk again and a rejected one is reported and not rested
+    template <QuoteType kSide>
+    HintCold NoInline void restAtBound(const HotOrder &order, Price bound, Qty remainQty) {
+        HotOrder limitOrder = order;
+        limitOrder.type_ = OrderType::Limit;
+        limitOrder.price_ = bound;
+        if constexpr (RiskT::skEnabled) {
+            HotOrder remainder = limitOrder;
+            remainder.remainQty_ = remainQty;
+            if (!risk_.check(remainder, bestBidPrice_, bestAskPrice_)) [[unlikely]] {
+                return reportOrder(order.coid_, kSide, OrderStatus::Rejected, bound, 0, remainQty);
             }
-        } else {
-            bestBidPrice_ = std::numeric_limits<Price>::min();
+        }
+        const bool newLevel = restOrder(bookOf<kSide>(), limitOrder, remainQty);
+        Price &bestRef = bestPriceOf<kSide>();
+        if (newLevel && SideTraits<kSide>::better(bound, bestRef)) {
+            bestRef = bound;
         }
     }
 
-    inline void updateBestAskPrice(AsksT::iterator &it, Price price) {
-        if (!asks_.empty()) [[likely]] {
-            if (equal(price, bestAskPrice_)) [[unlikely]] {
-                bestAskPrice_ = it->first;
-            }
+    // whether the opposite side holds the whole qty of a FOK order within its limit
+    template <OrderType kType, QuoteType kSide>
+    HintCold NoInline bool fillable(const HotOrder &order, Price limit) {
+        const auto &depthRef = depthOf(bookOf<SideTraits<kSide>::skOpposite>());
+        if (kType == OrderType::Market && limit == SideTraits<kSide>::skMarketPrice) {
+            return depthRef.total() >= order.remainQty_;
         } else {
-            bestAskPrice_ = std::numeric_limits<Price>::max();
+            return depthRef.qtyUpTo(limit) >= order.remainQty_;
         }
     }
 
-    void updateAsks(const Order &orderRef, Qty remainQty) {
-        auto result = asks_.emplace(orderRef.price_, remainQty);
-        if (!result.second) {
-            result.first->second += remainQty;
-        } else {
-            if (lessThan(orderRef.price_, bestAskPrice_)) {
-                bestAskPrice_ = orderRef.price_;
+    ForceInline static bool isImmediate(TimeInForce tif) {
+        return tif == TimeInForce::IOC || tif == TimeInForce::FOK;
+    }
+
+    // consume resting orders of the level in time priority, return the unfilled qty.
+    // one copy shared by every kernel
+    HintHot NoInline Qty fillLevel(LevelQueue &level, const HotOrder &taker, Qty remainQty) {
+        while (remainQty && !level.empty()) {
+            RestingOrder &makerRef = orderPool_[level.head_];
+            if (makerRef.remainQty_ > remainQty) [[likely]] {
+                makerRef.remainQty_ -= remainQty;
+                level.qty_ -= remainQty;
+                metrics_.onFill(remainQty);
+                risk_.onFill(taker.coid_, taker.side_, remainQty, false);
+                risk_.onFill(makerRef.coid_, level.side_, remainQty, true);
+                reportFill(level.price_, remainQty, taker, 0, makerRef, level.side_);
+                remainQty = 0;
+            } else {
+                const Qty fillQty = makerRef.remainQty_;
+                remainQty -= fillQty;
+                level.remove(orderPool_, makerRef);
+                makerRef.remainQty_ = 0;
+                metrics_.onFill(fillQty);
+                risk_.onFill(taker.coid_, taker.side_, fillQty, false);
+                risk_.onFill(makerRef.coid_, level.side_, fillQty, true);
+                risk_.onRemove(makerRef.coid_, level.side_, 0);
+                reportFill(level.price_, fillQty, taker, remainQty, makerRef, level.side_);
+                index_.erase(makerRef.coid_);
+                orderPool_.deallocate(&makerRef);
             }
         }
+        return remainQty;
     }
 
-    void updateBids(const Order &orderRef, Qty remainQty) {
-        auto result = bids_.emplace(orderRef.price_, remainQty);
-        if (!result.second) {
-            result.first->second += remainQty;
+    ForceInline void reportOrder(uint64_t coid, QuoteType side, OrderStatus status, Price price, Qty lastQty,
+                                 Qty remainQty) {
+        if constexpr (SinkT::skEnabled) {
+            ExecReport report;
+            report.seqNum_ = ++seqNum_;
+            report.coid_ = coid;
+            report.price_ = price;
+            report.lastQty_ = lastQty;
+            report.remainQty_ = remainQty;
+            report.side_ = side;
+            report.status_ = status;
+            sink_.onExecReport(report);
+        }
+    }
+
+    // one trade and the execution reports of both orders
+    ForceInline void reportFill(Price price, Qty qty, const HotOrder &taker, Qty takerRemainQty,
+                                const RestingOrder &maker, QuoteType makerSide) {
+        if constexpr (SinkT::skEnabled) {
+            const bool constBuyTaker = (taker.side_ == QuoteType::Buy);
+            Trade trade;
+            trade.seqNum_ = ++seqNum_;
+            trade.tradeId_ = ++tradeId_;
+            trade.price_ = price;
+            trade.qty_ = qty;
+            trade.aggressorSide_ = taker.side_;
+            trade.bidOrderId_ = constBuyTaker ? taker.coid_ : maker.coid_;
+            trade.askOrderId_ = constBuyTaker ? maker.coid_ : taker.coid_;
+            sink_.onTrade(trade);
+
+            reportOrder(maker.coid_, makerSide,
+                        maker.remainQty_ ? OrderStatus::PartiallyFilled : OrderStatus::Filled, price, qty,
+                        maker.remainQty_);
+            reportOrder(taker.coid_, taker.side_,
+                        takerRemainQty ? OrderStatus::PartiallyFilled : OrderStatus::Filled, price, qty,
+                        takerRemainQty);
+        }
+    }
+
+    template <QuoteType kSide>
+    ForceInline auto &bookOf() {
+        if constexpr (kSide == QuoteType::Buy) {
+            return bids_;
+        } else {
+            return asks_;
+        }
+    }
+    template <QuoteType kSide>
+    ForceInline Price &bestPriceOf() {
+        if constexpr (kSide == QuoteType::Buy) {
+            return bestBidPrice_;
         } else {
-            if (greator(orderRef.price_, bestBidPrice_)) {
-                bestBidPrice_ = orderRef.price_;
+            return bestAskPrice_;
+        }
+    }
+    ForceInline auto &topOf(BidsT &) { return topBids_; }
+    ForceInline auto &topOf(AsksT &) { return topAsks_; }
+    ForceInline auto &depthOf(BidsT &) { return bidDepth_; }
+    ForceInline auto &depthOf(AsksT &) { return askDepth_; }
+    ForceInline static constexpr QuoteType sideOf(const BidsT &) { return QuoteType::Buy; }
+    ForceInline static constexpr QuoteType sideOf(const AsksT &) { return QuoteType::Sell; }
+
+    // qty of level changed by delta, the depth index follows every change,
+    // best levels are not tracked within a batch but rebuilt from the book at its end
+    template <class SideT>
+    ForceInline void onLevel(SideT &side, const LevelQueue &level, Qty delta) {
+        depthOf(side).add(level.price_, delta);
+        if (!topDeferred_) [[likely]] {
+            topOf(side).onLevel(level.price_, level.qty_);
+        }
+    }
+
+    void reconcileTop() {
+        topBids_.rebuild(bids_);
+        topAsks_.rebuild(asks_);
+        topDeferred_ = false;
+    }
+
+    template <class SideT>
+    void removeResting(SideT &side, RestingOrder *resting) {
+        risk_.onRemove(resting->coid_, sideOf(side), resting->remainQty_);
+        unlinkResting(side, resting);
+        orderPool_.deallocate(resting);
+    }
+
+    template <class SideT>
+    ForceInline void unlinkResting(SideT &side, RestingOrder *resting) {
+        LevelQueue *level = &levelPool_[resting->level_];
+        level->remove(orderPool_, *resting);
+        onLevel(side, *level, -resting->remainQty_);
+        if (level->empty()) {
+            side.erase(level->price_);
+            levelPool_.deallocate(level);
+        }
+    }
+
+    // queue the order at the tail of its level, return whether the level is new
+    template <class SideT>
+    ForceInline bool linkResting(SideT &side, RestingOrder *resting, Price price) {
+        auto result = side.emplace(price, nullptr);
+        if (result.second) {
+            LevelQueue *level = levelPool_.allocate();
+            level->head_ = level->tail_ = kNullHandle;
+            level->price_ = price;
+            level->qty_ = 0;
+            level->count_ = 0;
+            level->side_ = sideOf(side);
+            *(result.first) = level;
+        }
+        LevelQueue *level = *(result.first);
+        resting->level_ = levelPool_.handle(level);
+        level->pushBack(orderPool_, *resting, orderPool_.handle(resting));
+        onLevel(side, *level, resting->remainQty_);
+        return result.second;
+    }
+
+    // opposite best price is the one of the other side, an amended price crossing it is matched
+    template <class SideT>
+    void amendResting(SideT &side, Price &bestPrice, Price oppositeBestPrice, RestingOrder *resting, Price price,
+                      Qty qty, Qty remainQty) {
+        LevelQueue *level = &levelPool_[resting->level_];
+        const PoolHandle constHandle = orderPool_.handle(resting);
+        if (price == level->price_) [[likely]] {
+            const Qty constDelta = remainQty - resting->remainQty_;
+            if (remainQty <= resting->remainQty_) [[likely]] {
+                level->qty_ -= resting->remainQty_ - remainQty;
+                resting->remainQty_ = remainQty;
+            } else {
+                level->remove(orderPool_, *resting);
+                resting->remainQty_ = remainQty;
+                level->pushBack(orderPool_, *resting, constHandle);
             }
+            orderQty_[constHandle] = qty;
+            risk_.onAmend(resting->coid_, sideOf(side), constDelta);
+            onLevel(side, *level, constDelta);
+            reportOrder(resting->coid_, sideOf(side), OrderStatus::New, price, 0, remainQty);
+            return;
+        }
+
+        if (!SideT::TraitsT::better(oppositeBestPrice, price)) [[unlikely]] {
+            // crossing the spread, matched like an incoming limit order keeping the coid, risk passed it already
+            HotOrder order;
+            order.coid_ = resting->coid_;
+            order.side_ = sideOf(side);
+            order.type_ = OrderType::Limit;
+            order.price_ = price;
+            order.qty_ = qty;
+            order.remainQty_ = remainQty;
+            index_.erase(resting->coid_);
+            removeResting(side, resting);
+            bestPrice = side.bestPrice();
+            return dispatchOrder(order);
         }
+
+        risk_.onAmend(resting->coid_, sideOf(side), remainQty - resting->remainQty_);
+        unlinkResting(side, resting);
+        resting->remainQty_ = remainQty;
+        orderQty_[constHandle] = qty;
+        linkResting(side, resting, price);
+        bestPrice = side.bestPrice();
+        reportOrder(resting->coid_, sideOf(side), OrderStatus::New, price, 0, remainQty);
+    }
+
+    // queue the remaining qty at the tail of its level, return whether the level is new.
+    // the coid is not resting, see insertOrder. a full index throws before a pool entry is taken
+    template <class SideT>
+    ForceInline bool restOrder(SideT &side, const HotOrder &orderRef, Qty remainQty) {
+        index_.checkRoom();
+        RestingOrder *resting = orderPool_.allocate();
+        index_.insert(orderRef.coid_, resting);
+        if (remainQty == orderRef.remainQty_) {
+            reportOrder(orderRef.coid_, orderRef.side_, OrderStatus::New, orderRef.price_, 0, remainQty);
+        }
+        risk_.onRest(orderRef.coid_, orderRef.side_, remainQty);
+
+        resting->coid_ = orderRef.coid_;
+        resting->remainQty_ = remainQty;
+        orderQty_[orderPool_.handle(resting)] = orderRef.qty_;
+        return linkResting(side, resting, orderRef.price_);
+    }
+
+   private:
+    static size_t arenaSize(uint32_t maxOrders) {
+        return static_cast<size_t>(maxOrders) * (sizeof(RestingOrder) * 4 / 3 + sizeof(Qty)) + skArenaSlack;
     }
 
    private:
-    Price bestBidPrice_ = std::numeric_limits<Price>::min();
+    BrokerArena arena_;
+
+    Price bestBidPrice_ = BidsT::TraitsT::skWorstPrice;
     BidsT bids_;
 
-    Price bestAskPrice_ = std::numeric_limits<Price>::max();
+    Price bestAskPrice_ = AsksT::TraitsT::skWorstPrice;
     AsksT asks_;
+
+    // refilled from the book on read, hence mutable
+    mutable TopLevels<QuoteType::Buy, kBookDepth> topBids_;
+    mutable TopLevels<QuoteType::Sell, kBookDepth> topAsks_;
+    bool topDeferred_ = false;
+    // sum of the versions of topBids_ and topAsks_ when the book was last published
+    uint64_t publishedVersion_ = 0;
+
+    DepthIndex<QuoteType::Buy> bidDepth_;
+    DepthIndex<QuoteType::Sell> askDepth_;
+
+    FlatPool<LevelQueue> levelPool_;
+    FlatPool<RestingOrder> orderPool_;
+    OrderIndex<RestingOrder> index_;
+    // total qty of each resting order by pool handle, only read when amending
+    SideTable<Qty> orderQty_;
+
+    uint64_t seqNum_ = 0;
+    uint64_t tradeId_ = 0;
+    SinkT sink_;
+    [[no_unique_address]] MetricsT metrics_;
+    [[no_unique_address]] RiskT risk_;
+    MarketProtection protection_;
+#ifdef TOB_PERF_COUNTERS
+    PerfProfile *perfProfile_ = nullptr;
+#endif
 };
+
+using Broker = BrokerT<>;
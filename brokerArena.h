@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "memoryRegion.h"
+#include "util.h"
+
+// memory of every container of one broker (book sides, depth windows, pools, order index).
+// allocation bumps an offset through MemoryRegions mapped as ArenaConfig says, blocks up to
+// skMaxClassSize bytes go back to a free list of their size class (tree nodes come and go with the
+// levels), larger blocks are only given back by reset(). reset() rewinds the whole arena in O(1) and
+// keeps the regions mapped, faulted and locked for the next session, the containers start over
+// without freeing anything node by node.
+// not thread safe, owned by the matching thread like its broker.
+struct BrokerArena {
+    static constexpr size_t skClassSize = 16;
+    static constexpr size_t skClassCount = 32;
+    static constexpr size_t skMaxClassSize = skClassSize * (skClassCount - 1);
+    // pages are faulted when first touched, like heap memory
+    static constexpr ArenaConfig skOnDemand{false, false, false};
+
+    BrokerArena(size_t capacity, const ArenaConfig &config) : config_(config) {
+        regions_.push_back(std::make_unique<MemoryRegion>(capacity, config_));
+        base_ = regions_.front()->data();
+        size_ = regions_.front()->size();
+    }
+
+    BrokerArena(BrokerArena &&) = delete;
+    BrokerArena(const BrokerArena &) = delete;
+    BrokerArena &operator=(BrokerArena &&) = delete;
+    BrokerArena &operator=(const BrokerArena &) = delete;
+
+    HintHot void *allocate(size_t size, size_t align = skClassSize) {
+        const size_t constClass = (size + skClassSize - 1) / skClassSize;
+        if (constClass < skClassCount) [[likely]] {
+            // the whole class is handed out, deallocate() recycles it as such
+            size = constClass * skClassSize;
+            if (free_[constClass] && align <= skClassSize) {
+                FreeBlock *block = free_[constClass];
+                free_[constClass] = block->next_;
+                return block;
+            }
+        }
+
+        align = (align < skClassSize) ? skClassSize : align;
+        const size_t constOffset = (offset_ + align - 1) & ~(align - 1);
+        if (constOffset + size > size_) [[unlikely]] {
+            return allocateInNextRegion(size, align);
+        }
+        offset_ = constOffset + size;
+        return base_ + constOffset;
+    }
+
+    ForceInline void deallocate(void *p, size_t size) {
+        const size_t constClass = (size + skClassSize - 1) / skClassSize;
+        if (constClass < skClassCount) [[likely]] {
+            FreeBlock *block = static_cast<FreeBlock *>(p);
+            block->next_ = free_[constClass];
+            free_[constClass] = block;
+        }
+    }
+
+    // everything allocated so far is given back at once, the containers must forget it, see BrokerT::reset
+    void reset() {
+        current_ = 0;
+        base_ = regions_.front()->data();
+        size_ = regions_.front()->size();
+        offset_ = 0;
+        for (FreeBlock *&headRef : free_) {
+            headRef = nullptr;
+        }
+    }
+
+    ForceInline const ArenaConfig &config() const { return config_; }
+    ForceInline size_t regionCount() const { return regions_.size(); }
+    // bytes mapped, and bytes handed out since the last reset including the free lists
+    size_t capacity() const {
+        size_t capacity = 0;
+        for (const auto &region : regions_) {
+            capacity += region->size();
+        }
+        return capacity;
+    }
+    size_t used() const {
+        size_t used = offset_;
+        for (size_t i = 0; i < current_; i++) {
+            used += regions_[i]->size();
+        }
+        return used;
+    }
+
+   private:
+    struct FreeBlock {
+        FreeBlock *next_;
+    };
+
+    // the current region is full, move on to the next one, mapping one twice as large when the arena never
+    // went that far
+    HintCold NoInline void *allocateInNextRegion(size_t size, size_t align) {
+        while (++current_ < regions_.size() && regions_[current_]->size() < size) {
+        }
+        if (current_ == regions_.size()) {
+            const size_t constNextSize = 2 * regions_.back()->size();
+            regions_.push_back(std::make_unique<MemoryRegion>(
+                (size + align > constNextSize) ? size + align : constNextSize, config_));
+        }
+        base_ = regions_[current_]->data();
+        size_ = regions_[current_]->size();
+        offset_ = 0;
+        return allocate(size, align);
+    }
+
+   private:
+    char *base_ = nullptr;
+    size_t size_ = 0;
+    size_t offset_ = 0;
+    FreeBlock *free_[skClassCount] = {};
+
+    const ArenaConfig config_;
+    size_t current_ = 0;
+    std::vector<std::unique_ptr<MemoryRegion>> regions_;
+};
+
+// stateful allocator of std containers taking their nodes from a BrokerArena, copies and rebinds share it
+template <class T>
+struct ArenaAllocator {
+    using value_type = T;
+
+    explicit ArenaAllocator(BrokerArena *arena) noexcept : arena_(arena) {}
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U> &other) noexcept : arena_(other.arena()) {}
+
+    ForceInline T *allocate(size_t n) { return static_cast<T *>(arena_->allocate(n * sizeof(T), alignof(T))); }
+    ForceInline void deallocate(T *p, size_t n) { arena_->deallocate(p, n * sizeof(T)); }
+
+    ForceInline BrokerArena *arena() const { return arena_; }
+
+    template <class U>
+    ForceInline bool operator==(const ArenaAllocator<U> &other) const {
+        return arena_ == other.arena();
+    }
+
+   private:
+    BrokerArena *arena_ = nullptr;
+};
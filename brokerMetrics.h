@@ -0,0 +1,210 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include "latencyHistogram.h"
+#include "message.h"
+#include "seqlockBook.h"
+#include "util.h"
+
+// Broker updates its MetricsT with plain inline calls from the matching thread:
+//  onInsert() / onCancel(bool found)
+//  onLevelSwept() per level an incoming order matched against, onFill(Qty) per fill,
+//  onSweepEnd() once the incoming order stopped matching
+//  copyTo(BrokerMetricsSnapshot &)
+// NullMetrics compiles all of it away, BrokerMetrics keeps plain counters owned by the matching
+// thread, other threads only see them through BrokerT::metrics snapshots, e.g. via ShmMetricsWriter.
+
+// exact up to 15, sweeps longer than that are reported within 12%
+using SweepHistogram = LatencyHistogram<4>;
+
+struct PoolMetrics {
+    uint64_t highWaterMark_ = 0;
+    uint64_t freeListLength_ = 0;
+    uint64_t chunkCount_ = 0;
+};
+
+struct BrokerMetricsSnapshot {
+    // counters, 0 with NullMetrics
+    uint64_t inserts_ = 0;
+    uint64_t cancels_ = 0;
+    uint64_t cancelMisses_ = 0;
+    uint64_t sweeps_ = 0;
+    uint64_t fills_ = 0;
+    uint64_t filledQty_ = 0;
+    // levels swept and fills per matching incoming order
+    SweepHistogram sweepLevels_;
+    SweepHistogram sweepFills_;
+
+    // state of the book when the snapshot was taken, always filled
+    uint64_t bidLevels_ = 0;
+    uint64_t askLevels_ = 0;
+    int64_t bidQty_ = 0;
+    int64_t askQty_ = 0;
+    uint64_t restingOrders_ = 0;
+    PoolMetrics levelPool_;
+    PoolMetrics orderPool_;
+};
+
+struct NullMetrics {
+    static constexpr bool skEnabled = false;
+
+    ForceInline void onInsert() {}
+    ForceInline void onCancel(bool) {}
+    ForceInline void onLevelSwept() {}
+    ForceInline void onFill(Qty) {}
+    ForceInline void onSweepEnd() {}
+    ForceInline void copyTo(BrokerMetricsSnapshot &) const {}
+};
+
+// the counters written on every order share one cache line, the histograms written once per
+// matching order follow on their own lines, so nothing else of the broker shares them
+struct alignas(kDefaultCacheLineSize) BrokerMetrics {
+    static constexpr bool skEnabled = true;
+
+    BrokerMetrics() = default;
+    BrokerMetrics(BrokerMetrics &&) = delete;
+    BrokerMetrics(const BrokerMetrics &) = delete;
+    BrokerMetrics &operator=(BrokerMetrics &&) = delete;
+    BrokerMetrics &operator=(const BrokerMetrics &) = delete;
+
+    ForceInline void onInsert() { ++inserts_; }
+    ForceInline void onCancel(bool found) {
+        ++cancels_;
+        cancelMisses_ += !found;
+    }
+    ForceInline void onLevelSwept() { ++sweepLevels_; }
+    ForceInline void onFill(Qty qty) {
+        ++sweepFills_;
+        filledQty_ += qty;
+    }
+    ForceInline void onSweepEnd() {
+        if (!sweepLevels_) {
+            return;
+        }
+        ++sweeps_;
+        fills_ += sweepFills_;
+        levelsHistogram_.record(sweepLevels_);
+        fillsHistogram_.record(sweepFills_);
+        sweepLevels_ = sweepFills_ = 0;
+    }
+
+    void copyTo(BrokerMetricsSnapshot &snapshotRef) const {
+        snapshotRef.inserts_ = inserts_;
+        snapshotRef.cancels_ = cancels_;
+        snapshotRef.cancelMisses_ = cancelMisses_;
+        snapshotRef.sweeps_ = sweeps_;
+        snapshotRef.fills_ = fills_;
+        snapshotRef.filledQty_ = filledQty_;
+        snapshotRef.sweepLevels_ = levelsHistogram_;
+        snapshotRef.sweepFills_ = fillsHistogram_;
+    }
+
+   private:
+    uint64_t inserts_ = 0;
+    uint64_t cancels_ = 0;
+    uint64_t cancelMisses_ = 0;
+    uint64_t sweeps_ = 0;
+    uint64_t fills_ = 0;
+    uint64_t filledQty_ = 0;
+    // of the order being matched
+    uint32_t sweepLevels_ = 0;
+    uint32_t sweepFills_ = 0;
+
+    alignas(kDefaultCacheLineSize) SweepHistogram levelsHistogram_;
+    SweepHistogram fillsHistogram_;
+};
+
+struct MetricsHeader {
+    static constexpr uint64_t skMagic = 0x5343495254454D42ull;  // "BMETRICS"
+    static constexpr uint32_t skLayoutVersion = 1;
+
+    uint64_t magic_ = skMagic;
+    uint32_t layoutVersion_ = skLayoutVersion;
+    uint32_t snapshotSize_ = sizeof(BrokerMetricsSnapshot);
+
+    SeqlockValue<BrokerMetricsSnapshot> snapshot_;
+};
+
+// latest metrics snapshot in shared memory (shm_open) for a monitor in another process. the matching
+// thread publishes whenever it suits it, the monitor never slows it down, see SeqlockValue
+struct ShmMetricsWriter {
+    explicit ShmMetricsWriter(const std::string &name) : name_(name) {
+        const int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+        if (fd < 0) {
+            throw std::runtime_error("shm_open failed for " + name);
+        }
+        const bool constSized = !ftruncate(fd, sizeof(MetricsHeader));
+        void *base =
+            constSized ? mmap(nullptr, sizeof(MetricsHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        close(fd);
+        if (base == MAP_FAILED) {
+            shm_unlink(name.c_str());
+            throw std::runtime_error("failed to map " + name);
+        }
+        header_ = new (base) MetricsHeader();
+    }
+
+    ~ShmMetricsWriter() {
+        munmap(header_, sizeof(MetricsHeader));
+        shm_unlink(name_.c_str());
+    }
+
+    ShmMetricsWriter(ShmMetricsWriter &&) = delete;
+    ShmMetricsWriter(const ShmMetricsWriter &) = delete;
+    ShmMetricsWriter &operator=(ShmMetricsWriter &&) = delete;
+    ShmMetricsWriter &operator=(const ShmMetricsWriter &) = delete;
+
+    // snapshot of the broker straight into the shared slot, from the matching thread
+    template <class BrokerImplT>
+    void publish(const BrokerImplT &broker) {
+        header_->snapshot_.publish([&](BrokerMetricsSnapshot &snapshotRef) { broker.metrics(snapshotRef); });
+    }
+
+   private:
+    const std::string name_;
+    MetricsHeader *header_ = nullptr;
+};
+
+struct ShmMetricsReader {
+    explicit ShmMetricsReader(const std::string &name) {
+        const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            throw std::runtime_error("shm_open failed for " + name);
+        }
+        struct stat st;
+        void *base = fstat(fd, &st) ? MAP_FAILED : mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED) {
+            throw std::runtime_error("failed to map " + name);
+        }
+        size_ = st.st_size;
+        header_ = static_cast<const MetricsHeader *>(base);
+        if (size_ < sizeof(MetricsHeader) || header_->magic_ != MetricsHeader::skMagic ||
+            header_->layoutVersion_ != MetricsHeader::skLayoutVersion ||
+            header_->snapshotSize_ != sizeof(BrokerMetricsSnapshot)) {
+            munmap(base, size_);
+            throw std::runtime_error("unexpected layout of " + name);
+        }
+    }
+
+    ~ShmMetricsReader() { munmap(const_cast<MetricsHeader *>(header_), size_); }
+
+    ShmMetricsReader(ShmMetricsReader &&) = delete;
+    ShmMetricsReader(const ShmMetricsReader &) = delete;
+    ShmMetricsReader &operator=(ShmMetricsReader &&) = delete;
+    ShmMetricsReader &operator=(const ShmMetricsReader &) = delete;
+
+    // latest snapshot, return the number of snapshots published so far, 0 when none yet
+    ForceInline uint64_t read(BrokerMetricsSnapshot &snapshotRef) const { return header_->snapshot_.read(snapshotRef); }
+
+   private:
+    size_t size_ = 0;
+    const MetricsHeader *header_ = nullptr;
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "message.h"
+#include "spscRing.h"
+#include "threadUtil.h"
+#include "util.h"
+
+// one book per symbol, Order::sid_ indexes a dense array of brokers.
+// symbols are spread over shards round robin (sid % shards), each shard is a worker thread pinned
+// to its core which owns and matches the books of its symbols, so books never need a lock.
+// the queue and books of a shard are constructed by its worker, first touch places them and the
+// FlatPool chunks they allocate later on the NUMA node of that core.
+// a single producer thread feeds the shards through their SpscRing: an order with Canceled status
+// cancels the resting order, anything else is inserted (see BrokerT::cancelOrder(const Order &)).
+// brokers and their sinks may only be read by other threads after drain().
+template <class BrokerImplT, uint32_t kQueueSize = 4096>
+struct BrokerRegistry {
+    using QueueT = SpscRing<Order, kQueueSize>;
+    // orders a worker takes from its ring at once
+    static constexpr size_t skConsumeBatch = 64;
+
+    // cores: one shard per entry, a negative core leaves the worker unpinned
+    BrokerRegistry(uint32_t symbolCount, const std::vector<int32_t> &cores,
+                   uint32_t maxOrdersPerBook = BrokerImplT::skDefaultMaxOrders)
+        : symbolCount_(symbolCount), brokers_(new BrokerImplT *[symbolCount]()), shards_(cores.size()) {
+        if (shards_.empty()) {
+            throw std::invalid_argument("BrokerRegistry needs at least one shard");
+        }
+
+        threads_.reserve(shards_.size());
+        for (size_t i = 0; i < shards_.size(); i++) {
+            threads_.emplace_back([this, i, core = cores[i], maxOrdersPerBook] {
+                pinCurrentThread(core);
+                run(i, maxOrdersPerBook);
+            });
+        }
+        while (ready_.load(std::memory_order_acquire) != shards_.size()) {
+            cpuRelax();
+        }
+    }
+
+    ~BrokerRegistry() {
+        running_.store(false, std::memory_order_release);
+        for (auto &thread : threads_) {
+            thread.join();
+        }
+    }
+
+    BrokerRegistry(BrokerRegistry &&) = delete;
+    BrokerRegistry(const BrokerRegistry &) = delete;
+    BrokerRegistry &operator=(BrokerRegistry &&) = delete;
+    BrokerRegistry &operator=(const BrokerRegistry &) = delete;
+
+    ForceInline uint32_t symbolCount() const { return symbolCount_; }
+    ForceInline uint32_t shardCount() const { return shards_.size(); }
+    ForceInline uint32_t shardOf(uint32_t sid) const { return sid % shards_.size(); }
+
+    ForceInline BrokerImplT &broker(uint32_t sid) { return *brokers_[sid]; }
+
+    // producer, spin while the shard queue is full, return false for an unknown symbol
+    HintHot bool submit(const Order &order) {
+        const uint32_t constSid = static_cast<uint32_t>(order.sid_);
+        if (constSid >= symbolCount_) [[unlikely]] {
+            return false;
+        }
+
+        Shard &shard = *shards_[shardOf(constSid)];
+        while (!shard.queue_.tryPush(order)) [[unlikely]] {
+            cpuRelax();
+        }
+        ++shard.submitted_;
+        return true;
+    }
+
+    // producer, wait until the shards processed every submitted order
+    void drain() {
+        for (auto &shard : shards_) {
+            while (shard->processed_.load(std::memory_order_acquire) != shard->submitted_) {
+                cpuRelax();
+            }
+        }
+    }
+
+   private:
+    struct Shard {
+        QueueT queue_;
+        // written by the worker, read by the producer
+        alignas(kDefaultCacheLineSize) std::atomic<uint64_t> processed_{0};
+        // written by the producer only
+        alignas(kDefaultCacheLineSize) uint64_t submitted_ = 0;
+        std::vector<std::unique_ptr<BrokerImplT>> books_;
+    };
+
+    void run(size_t shardIndex, uint32_t maxOrdersPerBook) {
+        shards_[shardIndex] = std::make_unique<Shard>();
+        Shard &shard = *shards_[shardIndex];
+        for (uint32_t sid = shardIndex; sid < symbolCount_; sid += shards_.size()) {
+            shard.books_.emplace_back(std::make_unique<BrokerImplT>(maxOrdersPerBook));
+            brokers_[sid] = shard.books_.back().get();
+        }
+        ready_.fetch_add(1, std::memory_order_release);
+
+        uint64_t processed = 0;
+        while (running_.load(std::memory_order_relaxed) || !shard.queue_.empty()) {
+            const size_t constCount = shard.queue_.consume(
+                [this](const Order &order) {
+                    BrokerImplT &brokerRef = *brokers_[order.sid_];
+                    if (order.orderStatus_ == OrderStatus::Canceled) {
+                        brokerRef.cancelOrder(order);
+                    } else {
+                        brokerRef.insertOrder(order);
+                    }
+                },
+                skConsumeBatch);
+
+            if (constCount) [[likely]] {
+                processed += constCount;
+                shard.processed_.store(processed, std::memory_order_release);
+            } else {
+                cpuRelax();
+            }
+        }
+    }
+
+   private:
+    const uint32_t symbolCount_;
+    std::unique_ptr<BrokerImplT *[]> brokers_;
+    // each element is set by its worker before it reports ready
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::vector<std::thread> threads_;
+    std::atomic<uint32_t> ready_{0};
+    std::atomic<bool> running_{true};
+};
@@ -0,0 +1,323 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include "bookSide.h"
+#include "flatPool.h"
+#include "type.h"
+#include "util.h"
+
+// B+tree keyed by price in priority order, so the leftmost leaf holds the best levels
+// and walking the leaf list visits levels from the best.
+// keys of a node are contiguous (kFanout prices per node, 2 cache lines for 16) and
+// searched linearly, nodes come from FlatPool.
+// deletion frees a node only when it runs empty and never merges siblings,
+// the tree shrinks by collapsing a root with a single child.
+template <QuoteType kSide, class ValueT, uint32_t kFanout>
+struct BTreeBookSide {
+    using TraitsT = SideTraits<kSide>;
+
+    static_assert(kFanout >= 4, "fanout too small");
+    static constexpr uint32_t skLeafCapacity = kFanout;
+    static constexpr uint32_t skInnerCapacity = kFanout;
+    static constexpr uint32_t skMaxHeight = 24;
+
+    struct Leaf {
+        Price keys_[skLeafCapacity];
+        ValueT values_[skLeafCapacity];
+        Leaf *prev_ = nullptr;
+        Leaf *next_ = nullptr;
+        uint32_t size_ = 0;
+    };
+
+    // children_[i] holds keys k with keys_[i - 1] <= k < keys_[i] in priority order
+    struct Inner {
+        Price keys_[skInnerCapacity - 1];
+        void *children_[skInnerCapacity];
+        uint32_t size_ = 0;
+    };
+
+    explicit BTreeBookSide(BrokerArena &arena) : leafPool_(&arena), innerPool_(&arena) { root_ = first_ = newLeaf(); }
+    BTreeBookSide(BTreeBookSide &&) = delete;
+    BTreeBookSide(const BTreeBookSide &) = delete;
+    BTreeBookSide &operator=(BTreeBookSide &&) = delete;
+    BTreeBookSide &operator=(const BTreeBookSide &) = delete;
+
+    ForceInline bool empty() const { return !size_; }
+    ForceInline size_t size() const { return size_; }
+    // inner levels above the leaves, 0 while a single leaf is the root
+    ForceInline uint32_t height() const { return height_; }
+
+    // the nodes went back with the arena
+    void reset() {
+        leafPool_.reset();
+        innerPool_.reset();
+        height_ = 0;
+        size_ = 0;
+        root_ = first_ = newLeaf();
+    }
+
+    ForceInline Price bestPrice() const { return size_ ? first_->keys_[0] : TraitsT::skWorstPrice; }
+    ForceInline ValueT &best() { return first_->values_[0]; }
+
+    HintHot void popBest() {
+        if (first_->size_ > 1) [[likely]] {
+            removeAt(first_, 0);
+            --size_;
+        } else {
+            erase(first_->keys_[0]);
+        }
+    }
+
+    inline ValueT *find(Price price) {
+        Leaf *leaf = findLeaf(price);
+        const uint32_t i = lowerBound(leaf, price);
+        return (i < leaf->size_ && leaf->keys_[i] == price) ? &(leaf->values_[i]) : nullptr;
+    }
+
+    HintHot std::pair<ValueT *, bool> emplace(Price price, const ValueT &value) {
+        Inner *path[skMaxHeight];
+        uint32_t slots[skMaxHeight];
+        Leaf *leaf = findLeaf(price, path, slots);
+
+        uint32_t i = lowerBound(leaf, price);
+        if (i < leaf->size_ && leaf->keys_[i] == price) {
+            return {&(leaf->values_[i]), false};
+        }
+
+        ++size_;
+        if (leaf->size_ < skLeafCapacity) [[likely]] {
+            return {insertAt(leaf, i, price, value), true};
+        }
+
+        // split the full leaf, upper half goes to a new right sibling
+        Leaf *right = newLeaf();
+        constexpr uint32_t constHalf = skLeafCapacity / 2;
+        std::copy(leaf->keys_ + constHalf, leaf->keys_ + skLeafCapacity, right->keys_);
+        std::copy(leaf->values_ + constHalf, leaf->values_ + skLeafCapacity, right->values_);
+        right->size_ = skLeafCapacity - constHalf;
+        leaf->size_ = constHalf;
+
+        right->prev_ = leaf;
+        right->next_ = leaf->next_;
+        if (leaf->next_) {
+            leaf->next_->prev_ = right;
+        }
+        leaf->next_ = right;
+
+        ValueT *result = (i <= constHalf) ? insertAt(leaf, i, price, value)
+                                          : insertAt(right, i - constHalf, price, value);
+        insertChild(path, slots, height_, right->keys_[0], right);
+        return {result, true};
+    }
+
+    inline void erase(Price price) {
+        Inner *path[skMaxHeight];
+        uint32_t slots[skMaxHeight];
+        Leaf *leaf = findLeaf(price, path, slots);
+
+        const uint32_t i = lowerBound(leaf, price);
+        if (i >= leaf->size_ || leaf->keys_[i] != price) {
+            return;
+        }
+        removeAt(leaf, i);
+        --size_;
+
+        if (leaf->size_ || !height_) [[likely]] {
+            return;
+        }
+
+        // leaf ran empty, unlink and free it then drop it from its parents
+        if (leaf->prev_) {
+            leaf->prev_->next_ = leaf->next_;
+        } else {
+            first_ = leaf->next_;
+        }
+        if (leaf->next_) {
+            leaf->next_->prev_ = leaf->prev_;
+        }
+        leafPool_.deallocate(leaf);
+        removeChild(path, slots, height_);
+    }
+
+    // inner nodes are few and stay cached, only the leaf holding price is worth prefetching
+    ForceInline void prefetch(Price price) const {
+        const Leaf *leaf = findLeaf(price);
+        __builtin_prefetch(leaf->keys_);
+        __builtin_prefetch(leaf->values_);
+    }
+
+    template <class F>
+    void forEach(F &&fn) const {
+        for (const Leaf *leaf = first_; leaf; leaf = leaf->next_) {
+            for (uint32_t i = 0; i < leaf->size_; i++) {
+                if (!fn(leaf->keys_[i], leaf->values_[i])) {
+                    return;
+                }
+            }
+        }
+    }
+
+   private:
+    // number of keys with higher priority than price
+    ForceInline static uint32_t lowerBound(const Leaf *leaf, Price price) {
+        uint32_t i = 0;
+        for (uint32_t k = 0; k < leaf->size_; k++) {
+            i += TraitsT::better(leaf->keys_[k], price);
+        }
+        return i;
+    }
+
+    // index of the child which may hold price
+    ForceInline static uint32_t childIndex(const Inner *inner, Price price) {
+        uint32_t i = 0;
+        for (uint32_t k = 0; k + 1 < inner->size_; k++) {
+            i += !TraitsT::better(price, inner->keys_[k]);
+        }
+        return i;
+    }
+
+    ForceInline Leaf *findLeaf(Price price) const {
+        void *node = root_;
+        for (uint32_t h = height_; h; h--) {
+            Inner *inner = static_cast<Inner *>(node);
+            node = inner->children_[childIndex(inner, price)];
+        }
+        return static_cast<Leaf *>(node);
+    }
+
+    ForceInline Leaf *findLeaf(Price price, Inner **path, uint32_t *slots) const {
+        void *node = root_;
+        for (uint32_t h = 0; h < height_; h++) {
+            Inner *inner = static_cast<Inner *>(node);
+            path[h] = inner;
+            slots[h] = childIndex(inner, price);
+            node = inner->children_[slots[h]];
+        }
+        return static_cast<Leaf *>(node);
+    }
+
+    ForceInline static ValueT *insertAt(Leaf *leaf, uint32_t i, Price price, const ValueT &value) {
+        std::copy_backward(leaf->keys_ + i, leaf->keys_ + leaf->size_, leaf->keys_ + leaf->size_ + 1);
+        std::copy_backward(leaf->values_ + i, leaf->values_ + leaf->size_, leaf->values_ + leaf->size_ + 1);
+        leaf->keys_[i] = price;
+        leaf->values_[i] = value;
+        ++leaf->size_;
+        return &(leaf->values_[i]);
+    }
+
+    ForceInline static void removeAt(Leaf *leaf, uint32_t i) {
+        std::copy(leaf->keys_ + i + 1, leaf->keys_ + leaf->size_, leaf->keys_ + i);
+        std::copy(leaf->values_ + i + 1, leaf->values_ + leaf->size_, leaf->values_ + i);
+        --leaf->size_;
+    }
+
+    // insert child on the right of path[depth - 1]->children_[slots[depth - 1]], splitting full parents
+    void insertChild(Inner **path, uint32_t *slots, uint32_t depth, Price separator, void *child) {
+        while (depth) {
+            Inner *inner = path[--depth];
+            const uint32_t slot = slots[depth];
+            if (inner->size_ < skInnerCapacity) [[likely]] {
+                std::copy_backward(inner->keys_ + slot, inner->keys_ + inner->size_ - 1, inner->keys_ + inner->size_);
+                std::copy_backward(inner->children_ + slot + 1, inner->children_ + inner->size_,
+                                   inner->children_ + inner->size_ + 1);
+                inner->keys_[slot] = separator;
+                inner->children_[slot + 1] = child;
+                ++inner->size_;
+                return;
+            }
+
+            Price keys[skInnerCapacity];
+            void *children[skInnerCapacity + 1];
+            std::copy(inner->keys_, inner->keys_ + slot, keys);
+            keys[slot] = separator;
+            std::copy(inner->keys_ + slot, inner->keys_ + skInnerCapacity - 1, keys + slot + 1);
+            std::copy(inner->children_, inner->children_ + slot + 1, children);
+            children[slot + 1] = child;
+            std::copy(inner->children_ + slot + 1, inner->children_ + skInnerCapacity, children + slot + 2);
+
+            constexpr uint32_t constLeft = (skInnerCapacity + 1) / 2;
+            Inner *right = newInner();
+            std::copy(keys, keys + constLeft - 1, inner->keys_);
+            std::copy(children, children + constLeft, inner->children_);
+            inner->size_ = constLeft;
+            std::copy(keys + constLeft, keys + skInnerCapacity, right->keys_);
+            std::copy(children + constLeft, children + skInnerCapacity + 1, right->children_);
+            right->size_ = skInnerCapacity + 1 - constLeft;
+
+            separator = keys[constLeft - 1];
+            child = right;
+        }
+
+        // root was split
+        Inner *root = newInner();
+        root->keys_[0] = separator;
+        root->children_[0] = root_;
+        root->children_[1] = child;
+        root->size_ = 2;
+        root_ = root;
+        ++height_;
+    }
+
+    // remove path[depth - 1]->children_[slots[depth - 1]], freeing parents running empty
+    void removeChild(Inner **path, uint32_t *slots, uint32_t depth) {
+        while (depth) {
+            Inner *inner = path[--depth];
+            const uint32_t slot = slots[depth];
+            if (inner->size_ > 1) [[likely]] {
+                const uint32_t keyIndex = slot ? slot - 1 : 0;
+                std::copy(inner->keys_ + keyIndex + 1, inner->keys_ + inner->size_ - 1, inner->keys_ + keyIndex);
+                std::copy(inner->children_ + slot + 1, inner->children_ + inner->size_, inner->children_ + slot);
+                --inner->size_;
+                break;
+            }
+
+            if (!depth) {
+                // the last leaf is gone
+                innerPool_.deallocate(inner);
+                root_ = first_ = newLeaf();
+                height_ = 0;
+                return;
+            }
+            innerPool_.deallocate(inner);
+        }
+
+        while (height_ && static_cast<Inner *>(root_)->size_ == 1) {
+            Inner *root = static_cast<Inner *>(root_);
+            root_ = root->children_[0];
+            innerPool_.deallocate(root);
+            --height_;
+        }
+    }
+
+    inline Leaf *newLeaf() {
+        Leaf *leaf = leafPool_.allocate();
+        leaf->prev_ = leaf->next_ = nullptr;
+        leaf->size_ = 0;
+        return leaf;
+    }
+
+    inline Inner *newInner() {
+        Inner *inner = innerPool_.allocate();
+        inner->size_ = 0;
+        return inner;
+    }
+
+   private:
+    void *root_ = nullptr;
+    Leaf *first_ = nullptr;
+    uint32_t height_ = 0;
+    size_t size_ = 0;
+
+    FlatPool<Leaf> leafPool_;
+    FlatPool<Inner> innerPool_;
+};
+
+// B+tree backend, see BTreeBookSide
+template <uint32_t kFanout = 16>
+struct BTreeBook {
+    template <QuoteType kSide, class ValueT>
+    using SideT = BTreeBookSide<kSide, ValueT, kFanout>;
+};
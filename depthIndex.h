@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include "bookSide.h"
+#include "type.h"
+#include "util.h"
+
+// cumulative resting qty of one side by price, answers "qty available at prices at least as good
+// as P" in O(log levels) without touching the book, FOK orders are checked against it.
+// a window of levels consecutive ticks in ascending price order holds the qty of each tick and a Fenwick
+// tree of the sums of blocks of skBlockTicks ticks, so an update writes one tick and log(blocks) small nodes
+// which stay cached, a query adds log(blocks) nodes and at most one block of ticks.
+// levels outside the window go to a map walked from the best, like the ladder the window is anchored on
+// the first price and re-anchored only when the window runs empty.
+// the window is sized to the price range of the instrument and taken from the broker arena as it is used:
+// the tree when the first qty arrives and the ticks by pages of skPageTicks when first written, so a book
+// costs what its prices touch and reset() only forgets them.
+template <QuoteType kSide>
+struct DepthIndex {
+    using TraitsT = SideTraits<kSide>;
+    using OutsideT = std::map<Price, int64_t, typename TraitsT::CompareT,
+                              ArenaAllocator<std::pair<const Price, int64_t>>>;
+
+    static constexpr bool skIsBid = (kSide == QuoteType::Buy);
+    static constexpr uint32_t skBlockTicks = 64;
+    static constexpr uint32_t skPageTicks = 4096;
+    static constexpr uint32_t skDefaultLevels = 1 << 16;
+
+    // levels: ticks of the window, a power of 2 of at least skPageTicks
+    explicit DepthIndex(BrokerArena &arena, uint32_t levels = skDefaultLevels)
+        : levels_(levels),
+          blocks_(levels / skBlockTicks),
+          arena_(arena),
+          pages_(std::make_unique<Qty *[]>(levels / skPageTicks)),
+          outside_(typename OutsideT::allocator_type(&arena)) {
+        if ((levels & (levels - 1)) || levels < skPageTicks) {
+            throw std::invalid_argument("DepthIndex levels must be a power of 2 of at least skPageTicks");
+        }
+    }
+    DepthIndex(DepthIndex &&) = delete;
+    DepthIndex(const DepthIndex &) = delete;
+    DepthIndex &operator=(DepthIndex &&) = delete;
+    DepthIndex &operator=(const DepthIndex &) = delete;
+
+    ForceInline int64_t total() const { return total_; }
+    ForceInline uint32_t levels() const { return levels_; }
+
+    // after BrokerArena::reset, the tree, pages and outside nodes went back with the arena
+    void reset() {
+        base_ = 0;
+        windowQty_ = total_ = 0;
+        tree_ = nullptr;
+        for (uint32_t i = 0; i < levels_ / skPageTicks; i++) {
+            pages_[i] = nullptr;
+        }
+        std::construct_at(&outside_, outside_.get_allocator());
+    }
+
+    // qty resting at price changed by delta
+    HintHot void add(Price price, int64_t delta) {
+        total_ += delta;
+        if (!inWindow(price)) [[unlikely]] {
+            if (windowQty_) {
+                addOutside(price, delta);
+                return;
+            }
+            recenter(price);
+        }
+
+        addWindow(static_cast<uint32_t>(price - base_), delta);
+    }
+
+    // qty resting at price or better
+    HintHot int64_t qtyUpTo(Price price) const {
+        int64_t qty = 0;
+        if (windowQty_) {
+            if constexpr (skIsBid) {
+                if (price <= base_) {
+                    qty = windowQty_;
+                } else if (inWindow(price)) {
+                    qty = windowQty_ - prefix(static_cast<uint32_t>(price - base_));
+                }
+            } else {
+                if (price >= base_ + static_cast<Price>(levels_)) {
+                    qty = windowQty_;
+                } else if (inWindow(price)) {
+                    qty = prefix(static_cast<uint32_t>(price - base_) + 1);
+                }
+            }
+        }
+
+        for (auto it = outside_.begin(); it != outside_.end() && !TraitsT::better(price, it->first); it++) {
+            qty += it->second;
+        }
+        return qty;
+    }
+
+   private:
+    ForceInline bool inWindow(Price price) const { return static_cast<uint64_t>(price - base_) < levels_; }
+
+    ForceInline void addWindow(uint32_t tick, int64_t delta) {
+        Qty *page = pages_[tick / skPageTicks];
+        if (!page) [[unlikely]] {
+            page = takePage(tick / skPageTicks);
+        }
+        windowQty_ += delta;
+        page[tick % skPageTicks] += static_cast<Qty>(delta);
+        for (uint32_t i = tick / skBlockTicks + 1; i <= blocks_; i += i & (~i + 1)) {
+            tree_[i] += delta;
+        }
+    }
+
+    // sum of the first n ticks, n <= levels_, the window holds qty so the tree is there. the ticks of a block
+    // share a page, n on a block boundary (levels_ too) is summed by the tree alone and reads no page
+    ForceInline int64_t prefix(uint32_t n) const {
+        int64_t sum = 0;
+        for (uint32_t i = n / skBlockTicks; i; i &= i - 1) {
+            sum += tree_[i];
+        }
+        if (!(n % skBlockTicks)) {
+            return sum;
+        }
+        const Qty *page = pages_[n / skPageTicks];
+        if (page) {
+            for (uint32_t tick = n & ~(skBlockTicks - 1); tick < n; tick++) {
+                sum += page[tick % skPageTicks];
+            }
+        }
+        return sum;
+    }
+
+    template <class T>
+    HintCold T *takeZeroed(size_t count) {
+        T *values = static_cast<T *>(arena_.allocate(sizeof(T) * count, kDefaultCacheLineSize));
+        std::memset(values, 0, sizeof(T) * count);
+        return values;
+    }
+
+    HintCold NoInline Qty *takePage(uint32_t page) {
+        if (!tree_) {
+            // 1-based
+            tree_ = takeZeroed<int64_t>(blocks_ + 1);
+        }
+        return pages_[page] = takeZeroed<Qty>(skPageTicks);
+    }
+
+    HintCold NoInline void addOutside(Price price, int64_t delta) {
+        auto result = outside_.emplace(price, 0);
+        result.first->second += delta;
+        if (!result.first->second) {
+            outside_.erase(result.first);
+        }
+    }
+
+    // only called when the window is empty, so all ticks and blocks are zero
+    HintCold NoInline void recenter(Price price) {
+        base_ = price - static_cast<Price>(levels_ / 2);
+        for (auto it = outside_.begin(); it != outside_.end();) {
+            if (inWindow(it->first)) {
+                addWindow(static_cast<uint32_t>(it->first - base_), it->second);
+                it = outside_.erase(it);
+            } else {
+                it++;
+            }
+        }
+    }
+
+   private:
+    Price base_ = 0;
+    int64_t windowQty_ = 0;
+    int64_t total_ = 0;
+    const uint32_t levels_;
+    const uint32_t blocks_;
+    // 1-based, tree_[i] holds the sum of blocks (i - lowbit(i), i]
+    int64_t *tree_ = nullptr;
+    BrokerArena &arena_;
+    // a tick holds one level whose qty fits in Qty, a null page holds none
+    std::unique_ptr<Qty *[]> pages_;
+    OutsideT outside_;
+};
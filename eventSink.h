@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "message.h"
+#include "util.h"
+
+// Broker reports trades and order state transitions to its SinkT with plain inline calls:
+//  onTrade(const Trade &)
+//  onExecReport(const ExecReport &)
+// skEnabled = false lets the broker skip building the events at all.
+
+struct NullSink {
+    static constexpr bool skEnabled = false;
+
+    ForceInline void onTrade(const Trade &) {}
+    ForceInline void onExecReport(const ExecReport &) {}
+};
+
+enum class EventType : int8_t { Unknown = 0, Trade, ExecReport };
+
+struct BrokerEvent {
+    EventType type_ = EventType::Unknown;
+    union {
+        Trade trade_;
+        ExecReport report_;
+    };
+
+    BrokerEvent() : trade_() {}
+};
+
+// preallocated ring of events, the producer never blocks nor allocates:
+// when the consumer lags more than kCapacity events the oldest are overwritten,
+// overrun() counts them and the gap is visible in the sequence numbers.
+template <uint32_t kCapacity = 4096>
+struct EventRing {
+    static_assert((kCapacity & (kCapacity - 1)) == 0, "kCapacity must be power of 2");
+    static constexpr bool skEnabled = true;
+    static constexpr uint32_t skCapacity = kCapacity;
+    static constexpr uint32_t skMask = kCapacity - 1;
+
+    EventRing() = default;
+    EventRing(EventRing &&) = delete;
+    EventRing(const EventRing &) = delete;
+    EventRing &operator=(EventRing &&) = delete;
+    EventRing &operator=(const EventRing &) = delete;
+
+    ForceInline void onTrade(const Trade &trade) {
+        BrokerEvent &event = next();
+        event.type_ = EventType::Trade;
+        event.trade_ = trade;
+    }
+
+    ForceInline void onExecReport(const ExecReport &report) {
+        BrokerEvent &event = next();
+        event.type_ = EventType::ExecReport;
+        event.report_ = report;
+    }
+
+    ForceInline size_t size() const { return head_ - tail_; }
+    ForceInline uint64_t overrun() const { return overrun_; }
+
+    // visit and consume all pending events in order, fn(const BrokerEvent &)
+    template <class F>
+    size_t drain(F &&fn) {
+        const uint64_t constHead = head_;
+        const size_t constCount = constHead - tail_;
+        for (; tail_ != constHead; tail_++) {
+            fn(events_[tail_ & skMask]);
+        }
+        return constCount;
+    }
+
+   private:
+    ForceInline BrokerEvent &next() {
+        if (head_ - tail_ == kCapacity) [[unlikely]] {
+            ++tail_;
+            ++overrun_;
+        }
+        return events_[head_++ & skMask];
+    }
+
+   private:
+    uint64_t head_ = 0;
+    uint64_t tail_ = 0;
+    uint64_t overrun_ = 0;
+    BrokerEvent events_[kCapacity];
+};
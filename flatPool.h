@@ -3,11 +3,20 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <memory>
 #include <set>
 #include <stdexcept>
+#include <type_traits>
 #include <utility>
+#include <vector>
+#include "brokerArena.h"
+#include "memoryRegion.h"
 #include "util.h"
 
+// index of an entry of a FlatPool, see FlatPool::handle
+using PoolHandle = int32_t;
+constexpr PoolHandle kNullHandle = -1;
+
 template <class T>
 struct FlatPool final {
     using DataT = T;
@@ -29,7 +38,20 @@ struct FlatPool final {
     };
 
     FlatPool() = default;
-    ~FlatPool() = default;
+    // chunks are carved from the arena and handed out as they are, entries are initialized by allocate()
+    // and its caller like a reused entry is, so T must be trivially destructible
+    explicit FlatPool(BrokerArena* arena) : arena_(arena) {
+        static_assert(std::is_trivially_destructible_v<DataT>, "arena chunks are never destroyed");
+    }
+    ~FlatPool() {
+        for (int32_t i = 0; i < constructedChunks_ && !arena_; i++) {
+            if (inRegion(chunks_[i].entry_)) {
+                std::destroy_n(chunks_[i].entry_, Chunk::skSize);
+            } else {
+                delete[] chunks_[i].entry_;
+            }
+        }
+    }
 
     FlatPool(FlatPool&& other) = delete;
     FlatPool(const FlatPool& other) = delete;
@@ -47,6 +69,7 @@ struct FlatPool final {
         } else {
             DataEntry& entry = at(freeIndex_);
             freeIndex_ = *(reinterpret_cast<int32_t*>(&entry));
+            --freeCount_;
             return &(entry.data_);
         }
     }
@@ -58,11 +81,82 @@ struct FlatPool final {
         if ((entry->secret_ ^ skMagicKey) == entry->index_) [[likely]] {
             *(reinterpret_cast<int32_t*>(const_cast<DataT*>(data))) = freeIndex_;
             freeIndex_ = entry->index_;
+            ++freeCount_;
         }
     }
 
+    // handle of an entry handed out by allocate(), valid until it is deallocated. handles are dense from 0
+    // so they index side tables as well, see SideTable
+    ForceInline PoolHandle handle(const DataT* data) const {
+        return reinterpret_cast<const DataEntry*>(data)->index_;
+    }
+    ForceInline DataT& operator[](PoolHandle handle) { return at(handle).data_; }
+    ForceInline const DataT& operator[](PoolHandle handle) const { return at(handle).data_; }
+
     constexpr size_t max_size() const { return SelfT::skChunkCapacity * SelfT::skMaxChunkSize; }
 
+    // entries ever handed out, entries waiting in the free list and chunks allocated
+    inline size_t highWaterMark() const { return latestIndex_ + 1; }
+    inline size_t freeListLength() const { return freeCount_; }
+    inline size_t chunkCount() const { return constructedChunks_; }
+    // entries allocate() hands out before it needs a new chunk
+    inline size_t reserved() const {
+        return static_cast<size_t>(constructedChunks_) * SelfT::skChunkCapacity - latestIndex_ - 1;
+    }
+
+    // construct the chunks for n more entries now in one MemoryRegion, so allocate() does not call
+    // new nor take a first touch page fault until they are used up.
+    // with an arena the chunks are carved from it and prefaulted, config is the one of the arena
+    void reserve(size_t n, const ArenaConfig& config = ArenaConfig()) {
+        const size_t constAvailable = reserved();
+        if (n <= constAvailable) {
+            return;
+        }
+        const int32_t constChunks =
+            static_cast<int32_t>((n - constAvailable + SelfT::skChunkCapacityMask) >> SelfT::skChunkCapacityExponent);
+        if (constructedChunks_ + constChunks > SelfT::skMaxChunkSize) {
+            throw std::out_of_range("FlatPool chunk limit reached");
+        }
+
+        if (arena_) {
+            for (int32_t i = 0; i < constChunks; i++) {
+                Chunk& chunkRef = chunks_[constructedChunks_++];
+                chunkRef.entry_ = carveChunk();
+                MemoryRegion::prefault(reinterpret_cast<char*>(chunkRef.entry_), sizeof(DataEntry) * Chunk::skSize);
+            }
+            return;
+        }
+
+        auto region = std::make_unique<MemoryRegion>(sizeof(DataEntry) * Chunk::skSize * constChunks, config);
+        DataEntry* entries = reinterpret_cast<DataEntry*>(region->data());
+        for (int32_t i = 0; i < constChunks; i++) {
+            chunks_[constructedChunks_++].construct(entries + static_cast<size_t>(i) * Chunk::skSize);
+        }
+        regions_.push_back(std::move(region));
+    }
+
+    // forget every entry in O(1) without destroying any. chunks of the heap and of reserve() are
+    // handed out again, chunks of an arena go back with it, see BrokerArena::reset
+    void reset() {
+        freeIndex_ = latestIndex_ = latestChunkIndex_ = SelfT::skInvalidIndex;
+        freeCount_ = 0;
+        if (arena_) {
+            constructedChunks_ = 0;
+        }
+    }
+
+    // read every cache line of the chunks with entries not handed out yet, e.g. right before the
+    // session opens, so their page table entries and lines are warm
+    void warmup() const {
+        for (int32_t i = (latestIndex_ + 1) >> SelfT::skChunkCapacityExponent; i < constructedChunks_; i++) {
+            const char* begin = reinterpret_cast<const char*>(chunks_[i].entry_);
+            const char* end = begin + sizeof(DataEntry) * Chunk::skSize;
+            for (const char* p = begin; p < end; p += kDefaultCacheLineSize) {
+                *static_cast<const volatile char*>(p);
+            }
+        }
+    }
+
    private:
     struct alignas(8) DataEntry {
         DataT data_;
@@ -78,15 +172,12 @@ struct FlatPool final {
 
         DataEntry* entry_ = nullptr;
 
-        Chunk() = default;
-        ~Chunk() {
-            if (entry_) {
-                delete[] entry_;
-            }
-        }
-
         constexpr int32_t capacity() { return Chunk::skSize; }
         void construct() { entry_ = new DataEntry[Chunk::skSize]; }
+        void construct(DataEntry* storage) {
+            std::uninitialized_default_construct_n(storage, Chunk::skSize);
+            entry_ = storage;
+        }
 
         inline DataEntry& operator[](uint32_t index) { return entry_[index & Chunk::skMask]; }
         inline const DataEntry& operator[](uint32_t index) const { return entry_[index & Chunk::skMask]; }
@@ -105,15 +196,40 @@ struct FlatPool final {
                 throw std::out_of_range("FlatPool chunk limit reached");
             }
             Chunk& chunkRef = chunks_[++latestChunkIndex_];
-            chunkRef.construct();
+            if (latestChunkIndex_ == constructedChunks_) [[unlikely]] {
+                if (arena_) {
+                    chunkRef.entry_ = carveChunk();
+                } else {
+                    chunkRef.construct();
+                }
+                ++constructedChunks_;
+            }
             return chunkRef;
         }
     }
 
+    inline DataEntry* carveChunk() {
+        return static_cast<DataEntry*>(arena_->allocate(sizeof(DataEntry) * Chunk::skSize, kDefaultCacheLineSize));
+    }
+
+    inline bool inRegion(const DataEntry* entry) const {
+        for (const auto& region : regions_) {
+            if (region->contains(entry)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
    private:
     int32_t freeIndex_ = SelfT::skInvalidIndex;
     int32_t latestIndex_ = SelfT::skInvalidIndex;
     int32_t latestChunkIndex_ = SelfT::skInvalidIndex;
+    int32_t freeCount_ = 0;
+    int32_t constructedChunks_ = 0;
+
+    BrokerArena* const arena_ = nullptr;
+    std::vector<std::unique_ptr<MemoryRegion>> regions_;
 
     Chunk chunks_[SelfT::skMaxChunkSize];
 };
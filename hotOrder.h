@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include "flatPool.h"
+#include "message.h"
+#include "sideTable.h"
+#include "type.h"
+
+// what the matching core reads of an incoming order, naturally aligned in 32 bytes (Order is 81 packed).
+// price_ is in ticks, see TickScale. handle_ is the row of the cold fields in a ColdOrderTable of the
+// gateway, the broker never reads it
+struct HotOrder {
+    uint64_t coid_ = 0;
+    Price price_ = 0;
+    Qty qty_ = 0;
+    Qty remainQty_ = 0;
+    PoolHandle handle_ = kNullHandle;
+
+    QuoteType side_ = QuoteType::Buy;
+    OrderType type_ = OrderType::Limit;
+    TimeInForce tif_ = TimeInForce::Unknown;
+    OrderStatus orderStatus_ = OrderStatus::Unknown;
+};
+static_assert(sizeof(HotOrder) == 32 && alignof(HotOrder) == 8, "two hot orders per cache line");
+
+// the rest of Order, only needed to report back to the client
+struct ColdOrder {
+    Nanoseconds createTimeNs_ = 0;
+    Nanoseconds updateTimeNs_ = 0;
+    // sid_ ==> symbol(instrumentid)
+    int32_t sid_ = -1;
+    Offset offset_ = Offset::Unknown;
+    char eoid_[skDefaultIDLen] = {'\0'};
+};
+
+using ColdOrderTable = SideTable<ColdOrder>;
+
+inline void toHot(const Order &order, HotOrder &hotRef) {
+    hotRef.coid_ = order.coid_;
+    hotRef.price_ = order.price_;
+    hotRef.qty_ = order.qty_;
+    hotRef.remainQty_ = order.remainQty_;
+    hotRef.side_ = order.side_;
+    hotRef.type_ = order.type_;
+    hotRef.tif_ = order.tif_;
+    hotRef.orderStatus_ = order.orderStatus_;
+}
+
+inline void toCold(const Order &order, ColdOrder &coldRef) {
+    coldRef.createTimeNs_ = order.createTimeNs_;
+    coldRef.updateTimeNs_ = order.updateTimeNs_;
+    coldRef.sid_ = order.sid_;
+    coldRef.offset_ = order.offset_;
+    std::memcpy(coldRef.eoid_, order.eoid_, sizeof(coldRef.eoid_));
+}
+
+// a new order, nothing of it is filled yet
+inline void toHot(const InsertOrder &insert, HotOrder &hotRef) {
+    hotRef.coid_ = insert.coid_.value_;
+    hotRef.price_ = insert.price_;
+    hotRef.qty_ = insert.qty_;
+    hotRef.remainQty_ = insert.qty_;
+    hotRef.side_ = insert.side_;
+    hotRef.type_ = insert.type_;
+    hotRef.tif_ = insert.tif_;
+    hotRef.orderStatus_ = OrderStatus::PendingNew;
+}
+
+inline void toCold(const InsertOrder &insert, ColdOrder &coldRef) {
+    coldRef.createTimeNs_ = coldRef.updateTimeNs_ = insert.tsNs_;
+    coldRef.sid_ = static_cast<int32_t>(insert.sid_);
+    coldRef.offset_ = insert.offset_;
+    coldRef.eoid_[0] = '\0';
+}
+
+// the wire order again, e.g. to report it
+inline void toOrder(const HotOrder &hot, const ColdOrder &cold, Order &orderRef) {
+    orderRef.coid_ = hot.coid_;
+    orderRef.sid_ = cold.sid_;
+    orderRef.side_ = hot.side_;
+    orderRef.orderStatus_ = hot.orderStatus_;
+    orderRef.type_ = hot.type_;
+    orderRef.offset_ = cold.offset_;
+    orderRef.tif_ = hot.tif_;
+    orderRef.price_ = hot.price_;
+    orderRef.qty_ = hot.qty_;
+    orderRef.remainQty_ = hot.remainQty_;
+    orderRef.createTimeNs_ = cold.createTimeNs_;
+    orderRef.updateTimeNs_ = cold.updateTimeNs_;
+    std::memcpy(orderRef.eoid_, cold.eoid_, sizeof(orderRef.eoid_));
+}
+
+// split a wire order, its cold fields are stored at handle
+inline void split(const Order &order, PoolHandle handle, HotOrder &hotRef, ColdOrderTable &coldTable) {
+    toHot(order, hotRef);
+    hotRef.handle_ = handle;
+    toCold(order, coldTable[handle]);
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <utility>
+#include "bookSide.h"
+#include "occupancyBitmap.h"
+#include "type.h"
+#include "util.h"
+
+// dense price ladder: a window of kLevels consecutive ticks stored in a contiguous array,
+// non-empty slots are tracked by a hierarchical occupancy bitmap.
+// prices outside the window (far from touch) go to an overflow map so memory stays bounded.
+// the window is anchored around the first price inserted and re-anchored only when
+// the ladder part runs empty, levels of the overflow falling into the new window are moved in.
+template <QuoteType kSide, class ValueT, uint32_t kLevels>
+struct LadderBookSide {
+    using TraitsT = SideTraits<kSide>;
+    using BitmapT = OccupancyBitmap<kLevels>;
+    using OverflowT = typename MapBookSide<kSide, ValueT, ArenaAllocator>::MapT;
+
+    static constexpr bool skIsBid = (kSide == QuoteType::Buy);
+    static constexpr uint32_t skNotFound = BitmapT::skNotFound;
+    static_assert((kLevels & (kLevels - 1)) == 0, "kLevels must be power of 2");
+
+    explicit LadderBookSide(BrokerArena &arena) : overflow_(typename OverflowT::allocator_type(&arena)) {}
+    LadderBookSide(LadderBookSide &&) = delete;
+    LadderBookSide(const LadderBookSide &) = delete;
+    LadderBookSide &operator=(LadderBookSide &&) = delete;
+    LadderBookSide &operator=(const LadderBookSide &) = delete;
+
+    ForceInline bool empty() const { return !ladderSize_ && overflow_.empty(); }
+    ForceInline size_t size() const { return ladderSize_ + overflow_.size(); }
+
+    // the bitmap is cleared, the overflow nodes went back with the arena
+    void reset() {
+        base_ = 0;
+        bestPrice_ = TraitsT::skWorstPrice;
+        bestSlot_ = skNotFound;
+        ladderSize_ = 0;
+        bestInLadder_ = false;
+        occupied_.clear();
+        std::construct_at(&overflow_, overflow_.get_allocator());
+    }
+
+    ForceInline Price bestPrice() const { return bestPrice_; }
+    ForceInline ValueT &best() { return bestInLadder_ ? levels_[bestSlot_] : overflow_.begin()->second; }
+
+    HintHot void popBest() {
+        if (bestInLadder_) [[likely]] {
+            occupied_.reset(bestSlot_);
+            --ladderSize_;
+            bestSlot_ = nextSlot(bestSlot_);
+        } else {
+            overflow_.erase(overflow_.begin());
+        }
+        refreshBest();
+    }
+
+    inline ValueT *find(Price price) {
+        if (inWindow(price)) [[likely]] {
+            const uint32_t slot = static_cast<uint32_t>(price - base_);
+            return occupied_.test(slot) ? &levels_[slot] : nullptr;
+        }
+
+        auto it = overflow_.find(price);
+        return (it != overflow_.end()) ? &(it->second) : nullptr;
+    }
+
+    HintHot std::pair<ValueT *, bool> emplace(Price price, const ValueT &value) {
+        if (!inWindow(price)) [[unlikely]] {
+            if (ladderSize_) {
+                auto result = overflow_.emplace(price, value);
+                if (result.second && TraitsT::better(price, bestPrice_)) {
+                    bestPrice_ = price;
+                    bestInLadder_ = false;
+                }
+                return {&(result.first->second), result.second};
+            }
+            recenter(price);
+        }
+
+        const uint32_t slot = static_cast<uint32_t>(price - base_);
+        if (occupied_.test(slot)) {
+            return {&levels_[slot], false};
+        }
+
+        levels_[slot] = value;
+        occupied_.set(slot);
+        ++ladderSize_;
+        if (bestSlot_ == skNotFound || TraitsT::better(price, base_ + bestSlot_)) {
+            bestSlot_ = slot;
+        }
+        if (TraitsT::better(price, bestPrice_)) {
+            bestPrice_ = price;
+            bestInLadder_ = true;
+        }
+        return {&levels_[slot], true};
+    }
+
+    inline void erase(Price price) {
+        if (inWindow(price)) [[likely]] {
+            const uint32_t slot = static_cast<uint32_t>(price - base_);
+            if (!occupied_.test(slot)) {
+                return;
+            }
+            occupied_.reset(slot);
+            --ladderSize_;
+            if (slot == bestSlot_) {
+                bestSlot_ = nextSlot(slot);
+            }
+        } else if (!overflow_.erase(price)) {
+            return;
+        }
+
+        if (price == bestPrice_) {
+            refreshBest();
+        }
+    }
+
+    ForceInline void prefetch(Price price) const {
+        if (inWindow(price)) [[likely]] {
+            __builtin_prefetch(&levels_[static_cast<uint32_t>(price - base_)]);
+        }
+    }
+
+    template <class F>
+    void forEach(F &&fn) const {
+        // overflow levels better than the window, then the ladder, then overflow levels worse than the window
+        auto it = overflow_.begin();
+        for (; it != overflow_.end() && TraitsT::better(it->first, bestEdge()); it++) {
+            if (!fn(it->first, it->second)) {
+                return;
+            }
+        }
+
+        for (uint32_t slot = bestSlot_; slot != skNotFound; slot = nextSlot(slot)) {
+            if (!fn(base_ + slot, levels_[slot])) {
+                return;
+            }
+        }
+
+        for (; it != overflow_.end(); it++) {
+            if (!fn(it->first, it->second)) {
+                return;
+            }
+        }
+    }
+
+   private:
+    ForceInline bool inWindow(Price price) const { return static_cast<uint64_t>(price - base_) < kLevels; }
+
+    ForceInline Price bestEdge() const { return skIsBid ? base_ + kLevels - 1 : base_; }
+    ForceInline Price worstEdge() const { return skIsBid ? base_ : base_ + kLevels - 1; }
+
+    ForceInline uint32_t firstSlot() const {
+        return skIsBid ? occupied_.findPrev(kLevels - 1) : occupied_.findNext(0);
+    }
+
+    // next occupied slot with lower priority
+    ForceInline uint32_t nextSlot(uint32_t slot) const {
+        if constexpr (skIsBid) {
+            return slot ? occupied_.findPrev(slot - 1) : skNotFound;
+        } else {
+            return occupied_.findNext(slot + 1);
+        }
+    }
+
+    ForceInline void refreshBest() {
+        const Price overflowBest = overflow_.empty() ? TraitsT::skWorstPrice : overflow_.begin()->first;
+        if (bestSlot_ != skNotFound && !TraitsT::better(overflowBest, base_ + bestSlot_)) [[likely]] {
+            bestPrice_ = base_ + bestSlot_;
+            bestInLadder_ = true;
+        } else {
+            bestPrice_ = overflowBest;
+            bestInLadder_ = false;
+        }
+    }
+
+    // only called when the ladder part is empty
+    HintCold NoInline void recenter(Price price) {
+        base_ = price - static_cast<Price>(kLevels / 2);
+
+        auto first = overflow_.lower_bound(bestEdge());
+        auto last = overflow_.upper_bound(worstEdge());
+        for (auto it = first; it != last; it++) {
+            const uint32_t slot = static_cast<uint32_t>(it->first - base_);
+            levels_[slot] = it->second;
+            occupied_.set(slot);
+            ++ladderSize_;
+        }
+        overflow_.erase(first, last);
+
+        bestSlot_ = firstSlot();
+        refreshBest();
+    }
+
+   private:
+    Price base_ = 0;
+    Price bestPrice_ = TraitsT::skWorstPrice;
+    uint32_t bestSlot_ = skNotFound;
+    uint32_t ladderSize_ = 0;
+    bool bestInLadder_ = false;
+
+    BitmapT occupied_;
+    alignas(kDefaultCacheLineSize) ValueT levels_[kLevels];
+    OverflowT overflow_;
+};
+
+// dense array backend, see LadderBookSide
+template <uint32_t kLevels = 4096>
+struct LadderBook {
+    template <QuoteType kSide, class ValueT>
+    using SideT = LadderBookSide<kSide, ValueT, kLevels>;
+};
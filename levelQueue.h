@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include "flatPool.h"
+#include "type.h"
+#include "util.h"
+
+// order resting in the book, node of the intrusive FIFO of its price level. only what matching reads
+// is kept: links are pool handles instead of pointers and the side is the one of the level, so a pool
+// entry is 32 bytes and a cache line holds two resting orders. the total qty is a cold field of the broker
+struct RestingOrder {
+    PoolHandle prev_ = kNullHandle;
+    PoolHandle next_ = kNullHandle;
+    // handle of its LevelQueue
+    PoolHandle level_ = kNullHandle;
+    Qty remainQty_ = 0;
+    uint64_t coid_ = 0;
+};
+static_assert(sizeof(RestingOrder) == 24, "a pool entry of 32 bytes");
+
+// price level holding its resting orders in time priority,
+// qty_ is kept equal to the sum of remainQty_ of the queued orders
+struct LevelQueue {
+    using OrdersT = FlatPool<RestingOrder>;
+
+    PoolHandle head_ = kNullHandle;
+    PoolHandle tail_ = kNullHandle;
+    Price price_ = 0;
+    Qty qty_ = 0;
+    uint32_t count_ = 0;
+    QuoteType side_ = QuoteType::Unknown;
+
+    ForceInline bool empty() const { return head_ == kNullHandle; }
+
+    // order is orders[handle], level_ is left to the caller
+    ForceInline void pushBack(OrdersT &orders, RestingOrder &order, PoolHandle handle) {
+        order.prev_ = tail_;
+        order.next_ = kNullHandle;
+        if (tail_ != kNullHandle) {
+            orders[tail_].next_ = handle;
+        } else {
+            head_ = handle;
+        }
+        tail_ = handle;
+        qty_ += order.remainQty_;
+        ++count_;
+    }
+
+    ForceInline void remove(OrdersT &orders, const RestingOrder &order) {
+        if (order.prev_ != kNullHandle) {
+            orders[order.prev_].next_ = order.next_;
+        } else {
+            head_ = order.next_;
+        }
+        if (order.next_ != kNullHandle) {
+            orders[order.next_].prev_ = order.prev_;
+        } else {
+            tail_ = order.prev_;
+        }
+        qty_ -= order.remainQty_;
+        --count_;
+    }
+};
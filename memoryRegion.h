@@ -0,0 +1,91 @@
+#pragma once
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include "util.h"
+
+// how a MemoryRegion is backed, every step is best effort except the mapping itself:
+//  hugePages_: MAP_HUGETLB from the reserved pool (vm.nr_hugepages), else transparent huge pages by madvise
+//  prefault_: every page is written once so no page fault is left for the hot path
+//  lock_: mlock, needs RLIMIT_MEMLOCK or CAP_IPC_LOCK
+struct ArenaConfig {
+    bool hugePages_ = true;
+    bool prefault_ = true;
+    bool lock_ = true;
+};
+
+// anonymous private mapping reserved up front, zero filled
+struct MemoryRegion {
+    static constexpr size_t skHugePageSize = 2 << 20;
+
+    MemoryRegion(size_t size, const ArenaConfig &config) {
+        const size_t constPageSize = sysconf(_SC_PAGESIZE);
+        size_ = (size + constPageSize - 1) & ~(constPageSize - 1);
+
+        void *base = MAP_FAILED;
+        if (config.hugePages_) {
+            const size_t constHugeSize = (size_ + skHugePageSize - 1) & ~(skHugePageSize - 1);
+            base = mmap(nullptr, constHugeSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (base != MAP_FAILED) {
+                size_ = constHugeSize;
+                hugeTlb_ = true;
+            }
+        }
+        if (base == MAP_FAILED) {
+            base = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (base == MAP_FAILED) {
+                throw std::runtime_error("MemoryRegion failed to map " + std::to_string(size_) + " bytes");
+            }
+            if (config.hugePages_) {
+                // must precede the first touch to get huge pages on fault
+                madvise(base, size_, MADV_HUGEPAGE);
+            }
+        }
+        data_ = static_cast<char *>(base);
+
+        if (config.prefault_) {
+            prefault();
+        }
+        locked_ = config.lock_ && !mlock(data_, size_);
+    }
+
+    ~MemoryRegion() { munmap(data_, size_); }
+
+    MemoryRegion(MemoryRegion &&) = delete;
+    MemoryRegion(const MemoryRegion &) = delete;
+    MemoryRegion &operator=(MemoryRegion &&) = delete;
+    MemoryRegion &operator=(const MemoryRegion &) = delete;
+
+    ForceInline char *data() const { return data_; }
+    ForceInline size_t size() const { return size_; }
+    ForceInline bool contains(const void *p) const {
+        return static_cast<size_t>(static_cast<const char *>(p) - data_) < size_;
+    }
+    // backed by MAP_HUGETLB pages, transparent huge pages are up to the kernel
+    ForceInline bool hugeTlb() const { return hugeTlb_; }
+    ForceInline bool locked() const { return locked_; }
+
+    void prefault() { prefault(data_, size_); }
+
+    // write every page of [data, data + size) once, keeping its content
+    static void prefault(char *data, size_t size) {
+        for (size_t offset = 0; offset < size; offset += 4096) {
+            volatile char *p = data + offset;
+            *p = *p;
+        }
+        if (size) {
+            volatile char *p = data + size - 1;
+            *p = *p;
+        }
+    }
+
+   private:
+    char *data_ = nullptr;
+    size_t size_ = 0;
+    bool hugeTlb_ = false;
+    bool locked_ = false;
+};
@@ -2,7 +2,6 @@
 
 #include <cstddef>
 #include <cstdint>
-#include "floatOp.h"
 #include "type.h"
 
 static constexpr int16_t skDefaultIDLen = 32;
@@ -37,12 +36,26 @@ union ClientOrderID {
     }
 } __attribute__((packed));
 
+// seqNum_ is shared by all events of a broker, so consumers can order and batch them
 struct Trade {
+    uint64_t seqNum_ = 0;
     uint64_t tradeId_ = 0;
     Price price_ = 0;
     Qty qty_ = 0;
-    int32_t bidOrderId_ = 0;
-    int32_t askOrderId_ = 0;
+    QuoteType aggressorSide_ = QuoteType::Unknown;
+    uint64_t bidOrderId_ = 0;
+    uint64_t askOrderId_ = 0;
+} __attribute__((packed));
+
+// order state transition, lastQty_ is the qty filled by this event
+struct ExecReport {
+    uint64_t seqNum_ = 0;
+    uint64_t coid_ = 0;
+    Price price_ = 0;
+    Qty lastQty_ = 0;
+    Qty remainQty_ = 0;
+    QuoteType side_ = QuoteType::Unknown;
+    OrderStatus status_ = OrderStatus::Unknown;
 } __attribute__((packed));
 
 struct InsertOrder {
@@ -71,7 +84,7 @@ struct Order {
     TimeInForce tif_ = TimeInForce::Unknown;
     // char reserve_[3] = {'\0'};
 
-    float price_ = 0.0;
+    Price price_ = 0;
     int32_t qty_ = 0.0;
     int32_t remainQty_ = 0.0;
 
@@ -111,3 +124,29 @@ struct Orderbook {
     const PriceLevel &bid(uint32_t i) const { return bids_[i]; }
     const PriceLevel &ask(uint32_t i) const { return asks_[i]; }
 } __attribute__((packed));
+
+struct PriceLevelUpdate {
+    QuoteType side_ = QuoteType::Unknown;
+    uint8_t rank_ = 0;
+    PriceLevel level_;
+} __attribute__((packed));
+
+// levels of Orderbook<N> changed since the previous delta
+template <size_t N>
+struct OrderbookDelta {
+    static constexpr size_t skMaxDepth = N;
+    uint16_t bidSize_ = 0;
+    uint16_t askSize_ = 0;
+    uint16_t updateSize_ = 0;
+    PriceLevelUpdate updates_[2 * N];
+
+    void applyTo(Orderbook<N> &ob) const {
+        for (uint16_t i = 0; i < updateSize_; i++) {
+            const PriceLevelUpdate &update = updates_[i];
+            PriceLevel &levelRef = (update.side_ == QuoteType::Buy) ? ob.bid(update.rank_) : ob.ask(update.rank_);
+            levelRef = update.level_;
+        }
+        ob.bidSize_ = bidSize_;
+        ob.askSize_ = askSize_;
+    }
+} __attribute__((packed));
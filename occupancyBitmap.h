@@ -0,0 +1,117 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include "util.h"
+
+// three level bitmap, bit i of a level is set when word i of the level below is not zero,
+// so finding the next/previous set bit is at most three tzcnt/lzcnt whatever the distance
+template <uint32_t kBits>
+struct OccupancyBitmap {
+    static_assert(kBits >= 64 && kBits % 64 == 0, "kBits must be a multiple of 64");
+    static_assert(kBits <= 64 * 64 * 64, "at most 3 levels of 64 bits words");
+
+    static constexpr uint32_t skNotFound = ~0u;
+    static constexpr uint32_t skL0Words = kBits / 64;
+    static constexpr uint32_t skL1Words = (skL0Words + 63) / 64;
+
+    ForceInline bool test(uint32_t i) const { return l0_[i >> 6] & (1ull << (i & 63)); }
+
+    ForceInline void set(uint32_t i) {
+        l0_[i >> 6] |= (1ull << (i & 63));
+        l1_[i >> 12] |= (1ull << ((i >> 6) & 63));
+        l2_ |= (1ull << (i >> 12));
+    }
+
+    ForceInline void reset(uint32_t i) {
+        l0_[i >> 6] &= ~(1ull << (i & 63));
+        if (!l0_[i >> 6]) {
+            l1_[i >> 12] &= ~(1ull << ((i >> 6) & 63));
+            if (!l1_[i >> 12]) {
+                l2_ &= ~(1ull << (i >> 12));
+            }
+        }
+    }
+
+    void clear() {
+        l2_ = 0;
+        std::memset(l1_, 0, sizeof(l1_));
+        std::memset(l0_, 0, sizeof(l0_));
+    }
+
+    ForceInline bool empty() const { return !l2_; }
+
+    // first set bit >= i
+    inline uint32_t findNext(uint32_t i) const {
+        if (i >= kBits) [[unlikely]] {
+            return skNotFound;
+        }
+
+        uint32_t w0 = i >> 6;
+        uint64_t mask = l0_[w0] & (~0ull << (i & 63));
+        if (mask) [[likely]] {
+            return (w0 << 6) | std::countr_zero(mask);
+        }
+
+        const uint32_t i1 = w0 + 1;
+        if (i1 >= skL0Words) {
+            return skNotFound;
+        }
+        uint32_t w1 = i1 >> 6;
+        mask = l1_[w1] & (~0ull << (i1 & 63));
+        if (!mask) {
+            const uint32_t i2 = w1 + 1;
+            if (i2 >= skL1Words) {
+                return skNotFound;
+            }
+            mask = l2_ & (~0ull << i2);
+            if (!mask) {
+                return skNotFound;
+            }
+            w1 = std::countr_zero(mask);
+            mask = l1_[w1];
+        }
+        w0 = (w1 << 6) | std::countr_zero(mask);
+        return (w0 << 6) | std::countr_zero(l0_[w0]);
+    }
+
+    // last set bit <= i
+    inline uint32_t findPrev(uint32_t i) const {
+        if (i >= kBits) [[unlikely]] {
+            i = kBits - 1;
+        }
+
+        uint32_t w0 = i >> 6;
+        uint64_t mask = l0_[w0] & (~0ull >> (63 - (i & 63)));
+        if (mask) [[likely]] {
+            return (w0 << 6) | (63 - std::countl_zero(mask));
+        }
+
+        if (!w0) {
+            return skNotFound;
+        }
+        const uint32_t i1 = w0 - 1;
+        uint32_t w1 = i1 >> 6;
+        mask = l1_[w1] & (~0ull >> (63 - (i1 & 63)));
+        if (!mask) {
+            if (!w1) {
+                return skNotFound;
+            }
+            const uint32_t i2 = w1 - 1;
+            mask = l2_ & (~0ull >> (63 - i2));
+            if (!mask) {
+                return skNotFound;
+            }
+            w1 = 63 - std::countl_zero(mask);
+            mask = l1_[w1];
+        }
+        w0 = (w1 << 6) | (63 - std::countl_zero(mask));
+        return (w0 << 6) | (63 - std::countl_zero(l0_[w0]));
+    }
+
+   private:
+    uint64_t l2_ = 0;
+    uint64_t l1_[skL1Words] = {0};
+    uint64_t l0_[skL0Words] = {0};
+};
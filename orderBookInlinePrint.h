@@ -4,6 +4,7 @@
 #include <iostream>
 #include <ostream>
 #include "broker.h"
+#include "tickScale.h"
 
 using namespace std;
 inline std::ostream &operator<<(std::ostream &out, const ClientOrderID &coid) {
@@ -33,3 +34,18 @@ void showOrderBook(const Orderbook<DEPTH> &ob) {
     }
     std::cout << "=============================================" << std::endl;
 }
+
+template <size_t DEPTH>
+void showOrderBook(const Orderbook<DEPTH> &ob, const TickScale &tickScale) {
+    std::cout << "===============orderbook::asks===============" << std::endl;
+    for (auto i = 0; i < ob.askSize_; i++) {
+        const PriceLevel &priceLevelRef = ob.ask(i);
+        std::cout << "price:" << tickScale.toDouble(priceLevelRef.price_) << " qty:" << priceLevelRef.qty_ << std::endl;
+    }
+    std::cout << "===============orderbook::bids===============" << std::endl;
+    for (auto i = 0; i < ob.bidSize_; i++) {
+        const PriceLevel &priceLevelRef = ob.bid(i);
+        std::cout << "price:" << tickScale.toDouble(priceLevelRef.price_) << " qty:" << priceLevelRef.qty_ << std::endl;
+    }
+    std::cout << "=============================================" << std::endl;
+}
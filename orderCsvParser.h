@@ -0,0 +1,392 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <immintrin.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include "message.h"
+#include "tickScale.h"
+#include "tscClock.h"
+#include "util.h"
+
+// streaming parser of the order csv of readme.txt (idx,time,price,volume,quote_type,order_type) into Order.
+// the file is mapped and delimiters are found 64 bytes at a time by SIMD compares folded
+// into a bitmask, one bit per byte. fields are converted without strtod or iostream: digits 8 at a time
+// in a general register (SWAR), prices straight to fixed point ticks of the TickScale, tokens as the
+// whole field in one register. limit orders rest (GTC), market orders are IOC and may have an empty price.
+// time is "HH:MM:SS[.fraction]" optionally preceded by "YYYY-MM-DD " (ns since midnight) or integer ns.
+// a header line is skipped, malformed lines throw std::invalid_argument with their line number.
+struct OrderCsvParser {
+    static constexpr size_t skBatchSize = 256;
+    // readable bytes past the data, SIMD and SWAR loads may run over the end of the last field
+    static constexpr size_t skPadding = 64;
+
+    explicit OrderCsvParser(const TickScale &tickScale) : tickScale_(tickScale), orders_(new Order[skBatchSize]) {
+        for (int64_t scale = tickScale.scale_; scale > 1; scale /= 10) {
+            if (scale % 10) {
+                throw std::invalid_argument("OrderCsvParser scale must be a power of 10");
+            }
+            ++decimals_;
+        }
+        if (decimals_ > 9 || tickScale.tickSize_ <= 0) {
+            throw std::invalid_argument("OrderCsvParser supports up to 9 decimals and a positive tick size");
+        }
+    }
+
+    OrderCsvParser(OrderCsvParser &&) = delete;
+    OrderCsvParser(const OrderCsvParser &) = delete;
+    OrderCsvParser &operator=(OrderCsvParser &&) = delete;
+    OrderCsvParser &operator=(const OrderCsvParser &) = delete;
+
+    // lines seen so far
+    ForceInline uint64_t lineNo() const { return lineNo_; }
+
+    // onBatch(std::span<const Order>) for every skBatchSize orders and the rest, return the orders parsed.
+    // the file is mapped and parsed in place with sequential read ahead, only its last bytes are copied
+    // to a padded buffer since loads may run past the end of the mapping
+    template <class F>
+    uint64_t parseFile(const std::string &path, F &&onBatch) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("failed to open " + path);
+        }
+        struct stat st;
+        if (fstat(fd, &st)) {
+            close(fd);
+            throw std::runtime_error("failed to stat " + path);
+        }
+        const size_t constSize = st.st_size;
+        uint64_t count = 0;
+        if (!constSize) {
+            close(fd);
+            return count;
+        }
+        void *base = mmap(nullptr, constSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED) {
+            throw std::runtime_error("failed to map " + path);
+        }
+        madvise(base, constSize, MADV_SEQUENTIAL);
+        const char *data = static_cast<const char *>(base);
+
+        try {
+            const size_t constInPlace = (constSize > skPadding) ? constSize - skPadding : 0;
+            const size_t constConsumed = parse(data, constInPlace, onBatch, count);
+
+            std::string tail(data + constConsumed, data + constSize);
+            if (tail.back() != '\n') {
+                tail.push_back('\n');
+            }
+            const size_t constTailSize = tail.size();
+            tail.resize(constTailSize + skPadding, '\0');
+            parse(tail.data(), constTailSize, onBatch, count);
+        } catch (...) {
+            munmap(base, constSize);
+            throw;
+        }
+        munmap(base, constSize);
+        return count;
+    }
+
+    // complete lines of [data, data + size), data must be readable up to size + skPadding,
+    // count is increased by the orders parsed, return the bytes consumed
+    template <class F>
+    HintHot size_t parse(const char *data, size_t size, F &&onBatch, uint64_t &count) {
+        std::string_view fields[skFieldCount];
+        uint32_t field = 0;
+        const char *fieldBegin = data;
+        size_t consumed = 0;
+
+        for (size_t offset = 0; offset < size; offset += 64) {
+            uint64_t mask = delimiterMask(data + offset);
+            if (size - offset < 64) {
+                mask &= (1ull << (size - offset)) - 1;
+            }
+            while (mask) {
+                const char *p = data + offset + __builtin_ctzll(mask);
+                mask &= mask - 1;
+                if (field < skFieldCount) [[likely]] {
+                    fields[field] = std::string_view(fieldBegin, p - fieldBegin);
+                }
+                ++field;
+                fieldBegin = p + 1;
+                if (*p == '\n') {
+                    if (parseLine(fields, field)) [[likely]] {
+                        if (++batchSize_ == skBatchSize) {
+                            count += flush(onBatch);
+                        }
+                    }
+                    field = 0;
+                    consumed = fieldBegin - data;
+                }
+            }
+        }
+        count += flush(onBatch);
+        return consumed;
+    }
+
+   private:
+    static constexpr uint32_t skFieldCount = 6;
+    static constexpr uint64_t skPow10[] = {1,      10,      100,      1000,      10000,
+                                           100000, 1000000, 10000000, 100000000, 1000000000};
+
+    template <class F>
+    ForceInline size_t flush(F &&onBatch) {
+        const size_t constSize = batchSize_;
+        if (constSize) {
+            batchSize_ = 0;
+            onBatch(std::span<const Order>(orders_.get(), constSize));
+        }
+        return constSize;
+    }
+
+    // bit i is set when p[i] is ',' or '\n'
+    ForceInline static uint64_t delimiterMask(const char *p) {
+#ifdef __AVX2__
+        const __m256i constComma = _mm256_set1_epi8(',');
+        const __m256i constNewline = _mm256_set1_epi8('\n');
+        const __m256i constLow = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        const __m256i constHigh = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 32));
+        const uint32_t constLowMask = _mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(constLow, constComma), _mm256_cmpeq_epi8(constLow, constNewline)));
+        const uint32_t constHighMask = _mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(constHigh, constComma), _mm256_cmpeq_epi8(constHigh, constNewline)));
+        return constLowMask | (static_cast<uint64_t>(constHighMask) << 32);
+#else
+        const __m128i constComma = _mm_set1_epi8(',');
+        const __m128i constNewline = _mm_set1_epi8('\n');
+        uint64_t mask = 0;
+        for (uint32_t i = 0; i < 4; i++) {
+            const __m128i constBytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16 * i));
+            const uint32_t constMask = _mm_movemask_epi8(
+                _mm_or_si128(_mm_cmpeq_epi8(constBytes, constComma), _mm_cmpeq_epi8(constBytes, constNewline)));
+            mask |= static_cast<uint64_t>(constMask) << (16 * i);
+        }
+        return mask;
+#endif
+    }
+
+    // whole field compare in one register, the field is readable 8 bytes past its start
+    template <size_t N>
+    ForceInline static bool isToken(std::string_view text, const char (&token)[N]) {
+        static_assert(N <= 9, "tokens are at most 8 bytes");
+        uint64_t chunk, expected = 0;
+        std::memcpy(&chunk, text.data(), sizeof(chunk));
+        std::memcpy(&expected, token, N - 1);
+        return text.size() == N - 1 && (chunk & (~0ull >> (8 * (9 - N)))) == expected;
+    }
+
+    // every byte is '0' to '9'
+    ForceInline static bool isDigits8(uint64_t chunk) {
+        return ((chunk & 0xF0F0F0F0F0F0F0F0ull) | (((chunk + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) ==
+               0x3333333333333333ull;
+    }
+
+    // value of the n <= 8 digits at p, false when one of them is not a digit
+    ForceInline static bool parseDigits8(const char *p, size_t n, uint64_t &value) {
+        uint64_t chunk;
+        std::memcpy(&chunk, p, sizeof(chunk));
+        // keep the n digits as the last bytes, leading bytes become '0'
+        if (n < 8) {
+            chunk = (chunk << (8 * (8 - n))) | (0x3030303030303030ull >> (8 * n));
+        }
+        if (!isDigits8(chunk)) [[unlikely]] {
+            return false;
+        }
+        chunk = ((chunk & 0x0F0F0F0F0F0F0F0Full) * 2561) >> 8;
+        chunk = ((chunk & 0x00FF00FF00FF00FFull) * 6553601) >> 16;
+        value = ((chunk & 0x0000FFFF0000FFFFull) * 42949672960001ull) >> 32;
+        return true;
+    }
+
+    ForceInline static bool parseUInt(const char *p, size_t n, uint64_t &value) {
+        if (n - 1 < 8) [[likely]] {
+            return parseDigits8(p, n, value);
+        }
+        if (n - 1 < 16) {
+            uint64_t high = 0, low = 0;
+            if (!parseDigits8(p, n - 8, high) || !parseDigits8(p + n - 8, 8, low)) {
+                return false;
+            }
+            value = high * skPow10[8] + low;
+            return true;
+        }
+        if (n - 1 < 19) {
+            uint64_t high = 0, middle = 0, low = 0;
+            if (!parseDigits8(p, n - 16, high) || !parseDigits8(p + n - 16, 8, middle) ||
+                !parseDigits8(p + n - 8, 8, low)) {
+                return false;
+            }
+            value = (high * skPow10[8] + middle) * skPow10[8] + low;
+            return true;
+        }
+        return false;
+    }
+
+    ForceInline static bool parseTime(std::string_view text, Nanoseconds &tsNs) {
+        const char *p = text.data();
+        size_t n = text.size();
+        if (n >= 19 && (p[10] == ' ' || p[10] == 'T') && p[13] == ':') {
+            p += 11;
+            n -= 11;
+        } else if (n < 8 || p[2] != ':') {
+            return parseUInt(p, n, tsNs);
+        }
+        if (n < 8 || p[2] != ':' || p[5] != ':') [[unlikely]] {
+            return false;
+        }
+
+        // "HH:MM:SS" in one register: colons checked then turned into '0', each byte pair combined by a multiply
+        uint64_t chunk;
+        std::memcpy(&chunk, p, sizeof(chunk));
+        if ((chunk & 0x0000FF0000FF0000ull) != 0x00003A00003A0000ull) [[unlikely]] {
+            return false;
+        }
+        chunk ^= 0x00000A00000A0000ull;
+        if (!isDigits8(chunk)) [[unlikely]] {
+            return false;
+        }
+        chunk -= 0x3030303030303030ull;
+        chunk = chunk * 10 + (chunk >> 8);
+        tsNs = ((chunk & 0xFF) * 3600 + ((chunk >> 24) & 0xFF) * 60 + ((chunk >> 48) & 0xFF)) *
+               TimeConstant::skNsPerSecond;
+        if (n == 8) {
+            return true;
+        }
+
+        // up to 9 fraction digits
+        const size_t constDigits = n - 9;
+        uint64_t fraction = 0;
+        if (p[8] != '.' || constDigits - 1 >= 9 || !parseDigits8(p + 9, std::min<size_t>(constDigits, 8), fraction))
+            [[unlikely]] {
+            return false;
+        }
+        if (constDigits == 9) {
+            const uint64_t constLast = static_cast<uint8_t>(p[17] - '0');
+            if (constLast > 9) [[unlikely]] {
+                return false;
+            }
+            fraction = fraction * 10 + constLast;
+        }
+        tsNs += fraction * skPow10[9 - constDigits];
+        return true;
+    }
+
+    // decimal price to ticks without floating point, digits beyond the scale must be 0
+    ForceInline bool parsePrice(std::string_view text, Price &ticks) const {
+        const char *p = text.data();
+        size_t n = text.size();
+        const bool constNegative = n && *p == '-';
+        p += constNegative;
+        n -= constNegative;
+
+        // fields are short, a byte loop beats a memchr call
+        size_t intDigits = 0;
+        while (intDigits < n && p[intDigits] != '.') {
+            ++intDigits;
+        }
+        const char *constDot = p + intDigits;
+        size_t fractionDigits = (intDigits < n) ? n - intDigits - 1 : 0;
+        uint64_t units = 0, fraction = 0;
+        if (!parseUInt(p, intDigits, units)) [[unlikely]] {
+            return false;
+        }
+        if (fractionDigits > decimals_) [[unlikely]] {
+            uint64_t rest = 0;
+            if (!parseUInt(constDot + 1 + decimals_, fractionDigits - decimals_, rest) || rest) {
+                return false;
+            }
+            fractionDigits = decimals_;
+        }
+        if (fractionDigits && !parseUInt(constDot + 1, fractionDigits, fraction)) [[unlikely]] {
+            return false;
+        }
+        units = units * tickScale_.scale_ + fraction * skPow10[decimals_ - fractionDigits];
+
+        if (tickScale_.tickSize_ != 1) {
+            if (units % tickScale_.tickSize_) [[unlikely]] {
+                return false;
+            }
+            units /= tickScale_.tickSize_;
+        }
+        ticks = constNegative ? -static_cast<Price>(units) : static_cast<Price>(units);
+        return true;
+    }
+
+    // fill the next order of the batch, false for a header or an empty line
+    HintHot bool parseLine(std::string_view *fields, uint32_t fieldCount) {
+        ++lineNo_;
+        std::string_view &lastRef = fields[std::min(fieldCount, skFieldCount) - 1];
+        if (!lastRef.empty() && lastRef.back() == '\r') {
+            lastRef.remove_suffix(1);
+        }
+        if (fieldCount == 1 && fields[0].empty()) {
+            return false;
+        }
+
+        Order &orderRef = orders_[batchSize_];
+        uint64_t coid = 0;
+        if (!parseUInt(fields[0].data(), fields[0].size(), coid)) [[unlikely]] {
+            if (lineNo_ == 1) {
+                return false;
+            }
+            fail("bad idx");
+        }
+        if (fieldCount != skFieldCount) [[unlikely]] {
+            fail("expected 6 fields");
+        }
+        orderRef.coid_ = coid;
+        orderRef.orderStatus_ = OrderStatus::New;
+        Nanoseconds tsNs = 0;
+        if (!parseTime(fields[1], tsNs)) [[unlikely]] {
+            fail("bad time");
+        }
+        orderRef.createTimeNs_ = tsNs;
+
+        // sides and types come in random order, select without branches
+        const bool constBid = isToken(fields[4], "BID");
+        const bool constLimit = isToken(fields[5], "LIMIT");
+        if (!(constBid | isToken(fields[4], "ASK"))) [[unlikely]] {
+            fail("bad quote_type");
+        }
+        if (!(constLimit | isToken(fields[5], "MARKET"))) [[unlikely]] {
+            fail("bad order_type");
+        }
+        orderRef.side_ = constBid ? QuoteType::Buy : QuoteType::Sell;
+        orderRef.type_ = constLimit ? OrderType::Limit : OrderType::Market;
+        orderRef.tif_ = constLimit ? TimeInForce::GTC : TimeInForce::IOC;
+
+        Price price = 0;
+        if (!parsePrice(fields[2], price) && !(!constLimit && fields[2].empty())) [[unlikely]] {
+            fail("bad price");
+        }
+        orderRef.price_ = price;
+        uint64_t volume = 0;
+        if (!parseUInt(fields[3].data(), fields[3].size(), volume) || !volume || volume > INT32_MAX) [[unlikely]] {
+            fail("bad volume");
+        }
+        orderRef.qty_ = orderRef.remainQty_ = static_cast<Qty>(volume);
+        return true;
+    }
+
+    [[noreturn]] HintCold NoInline void fail(const char *what) const {
+        throw std::invalid_argument(std::string(what) + " at line " + std::to_string(lineNo_));
+    }
+
+   private:
+    const TickScale tickScale_;
+    uint32_t decimals_ = 0;
+    uint64_t lineNo_ = 0;
+
+    std::unique_ptr<Order[]> orders_;
+    size_t batchSize_ = 0;
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "message.h"
+#include "util.h"
+
+// kind of an order flow event, Count is the number of kinds
+enum class FlowOp : uint8_t { PassiveLimit = 0, AggressiveLimit, Market, Cancel, Count };
+
+struct OrderFlowConfig {
+    Price mid_ = 15000;
+    // passive limit prices are 1 + an exponential number of ticks with this mean away from mid,
+    // at most depthTicks_, so the book holds about depthTicks_ levels per side
+    double meanOffsetTicks_ = 8.0;
+    uint32_t depthTicks_ = 100;
+    // aggressive limit prices cross mid by 0 to aggressiveTicks_
+    uint32_t aggressiveTicks_ = 3;
+    // sizes follow Pareto(minQty_, paretoAlpha_) up to maxQty_, a heavy tail of large orders
+    Qty minQty_ = 1;
+    double paretoAlpha_ = 1.5;
+    Qty maxQty_ = 10000;
+    // share of each event kind, the rest are passive limit orders
+    double cancelRatio_ = 0.4;
+    double marketRatio_ = 0.02;
+    double aggressiveRatio_ = 0.05;
+    uint64_t seed_ = 1;
+};
+
+// an insert, or a cancel of order_.coid_ with Canceled status
+struct FlowEvent {
+    FlowOp op_ = FlowOp::PassiveLimit;
+    Order order_;
+};
+
+// random order flow around a fixed mid. cancels pick a random order inserted before that was not
+// canceled yet, which may be filled meanwhile like in a real feed.
+struct OrderFlowGenerator {
+    explicit OrderFlowGenerator(const OrderFlowConfig &config) : config_(config), rng_(config.seed_) {}
+
+    ForceInline const OrderFlowConfig &config() const { return config_; }
+    ForceInline size_t liveSize() const { return live_.size(); }
+
+    // next event, only passive limit orders while passiveOnly (e.g. to build the book up)
+    void next(FlowEvent &event, bool passiveOnly = false) {
+        const double constDraw = passiveOnly ? 1.0 : uniform_(rng_);
+        if (constDraw < config_.cancelRatio_ && !live_.empty()) {
+            event.op_ = FlowOp::Cancel;
+            const size_t constPick = rng_() % live_.size();
+            event.order_ = Order();
+            event.order_.coid_ = live_[constPick];
+            event.order_.orderStatus_ = OrderStatus::Canceled;
+            live_[constPick] = live_.back();
+            live_.pop_back();
+            return;
+        }
+
+        Order &orderRef = event.order_;
+        orderRef = Order();
+        orderRef.coid_ = ++coid_;
+        orderRef.createTimeNs_ = coid_;
+        orderRef.orderStatus_ = OrderStatus::New;
+        orderRef.side_ = (rng_() & 1) ? QuoteType::Buy : QuoteType::Sell;
+        orderRef.tif_ = TimeInForce::GTC;
+        orderRef.qty_ = orderRef.remainQty_ = drawQty();
+        const Price constSign = (orderRef.side_ == QuoteType::Buy) ? 1 : -1;
+
+        const double constAggressive = constDraw - config_.cancelRatio_;
+        if (constAggressive >= 0 && constAggressive < config_.marketRatio_) {
+            event.op_ = FlowOp::Market;
+            orderRef.type_ = OrderType::Market;
+            orderRef.tif_ = TimeInForce::IOC;
+            orderRef.price_ = config_.mid_;
+            return;
+        }
+        orderRef.type_ = OrderType::Limit;
+        if (constAggressive >= config_.marketRatio_ && constAggressive < config_.marketRatio_ + config_.aggressiveRatio_) {
+            event.op_ = FlowOp::AggressiveLimit;
+            orderRef.price_ = config_.mid_ + constSign * static_cast<Price>(rng_() % (config_.aggressiveTicks_ + 1));
+        } else {
+            event.op_ = FlowOp::PassiveLimit;
+            const double constOffset = 1.0 + offset_(rng_) * config_.meanOffsetTicks_;
+            orderRef.price_ = config_.mid_ - constSign * static_cast<Price>(std::min<double>(constOffset, config_.depthTicks_));
+        }
+        live_.push_back(orderRef.coid_);
+    }
+
+   private:
+    ForceInline Qty drawQty() {
+        // inverse transform of the Pareto distribution
+        const double constQty = config_.minQty_ / std::pow(1.0 - uniform_(rng_), 1.0 / config_.paretoAlpha_);
+        return static_cast<Qty>(std::min<double>(constQty, config_.maxQty_));
+    }
+
+   private:
+    const OrderFlowConfig config_;
+    std::mt19937_64 rng_;
+    std::uniform_real_distribution<double> uniform_{0.0, 1.0};
+    std::exponential_distribution<double> offset_{1.0};
+    uint64_t coid_ = 0;
+    std::vector<uint64_t> live_;
+};
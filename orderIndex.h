@@ -0,0 +1,159 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include "memoryRegion.h"
+#include "util.h"
+
+// open addressing (robin hood) hash index from client order id to T*.
+// the table is sized once for maxSize entries at a load factor <= 0.8 and never rehashes,
+// inserting beyond maxSize throws like FlatPool does when it runs out of chunks.
+// a slot is 16 bytes (key and pointer) and the probe distance is recomputed from the key, so a lookup
+// touches a single cache line most of the time. the high 16 bits of the pointer, unused by user space
+// addresses, hold the epoch the slot was written in and only slots of the current epoch are taken:
+// reset() starts a new epoch in O(1) instead of clearing the table.
+// the table is a MemoryRegion of its own kept across resets, mapped zero filled, and epoch 0 is never
+// current, so it is not written up front either.
+template <class T>
+struct OrderIndex final {
+    using SelfT = OrderIndex<T>;
+    static constexpr uint64_t skHashMultiplier = 0x9E3779B97F4A7C15ull;
+    static constexpr uint32_t skPointerBits = 48;
+    static constexpr uint64_t skPointerMask = (uint64_t{1} << skPointerBits) - 1;
+    static constexpr uint64_t skFirstEpoch = uint64_t{1} << skPointerBits;
+
+    // the table is mapped as config says, see ArenaConfig
+    OrderIndex(uint32_t maxSize, const ArenaConfig &config)
+        : capacity_(capacityFor(maxSize)),
+          mask_(capacity_ - 1),
+          shift_(64 - std::countr_zero(capacity_)),
+          maxSize_(maxSize),
+          region_(bytesFor(maxSize), config),
+          slots_(reinterpret_cast<Slot *>(region_.data())) {}
+
+    OrderIndex(OrderIndex &&) = delete;
+    OrderIndex(const OrderIndex &) = delete;
+    OrderIndex &operator=(OrderIndex &&) = delete;
+    OrderIndex &operator=(const OrderIndex &) = delete;
+
+    // slots and bytes of the table for maxSize entries
+    static constexpr uint64_t capacityFor(uint32_t maxSize) {
+        return std::bit_ceil(static_cast<uint64_t>(maxSize) + maxSize / 4 + 1);
+    }
+    static constexpr size_t bytesFor(uint32_t maxSize) { return capacityFor(maxSize) * sizeof(Slot); }
+
+    ForceInline size_t size() const { return size_; }
+    ForceInline size_t capacity() const { return capacity_; }
+
+    // empty in O(1), the slots of the previous epochs read as empty. the table is only cleared when the
+    // epoch wraps, once every 65535 resets
+    void reset() {
+        size_ = 0;
+        epoch_ += skFirstEpoch;
+        if (!epoch_) [[unlikely]] {
+            std::memset(slots_, 0, bytesFor(maxSize_));
+            epoch_ = skFirstEpoch;
+        }
+    }
+
+    ForceInline void prefetch(uint64_t key) const { __builtin_prefetch(&slots_[home(key)]); }
+
+    HintHot T *find(uint64_t key) const {
+        uint64_t pos = home(key);
+        for (uint64_t dist = 0;; dist++, pos = (pos + 1) & mask_) {
+            const Slot &slot = slots_[pos];
+            if (slot.key_ == key && live(slot)) [[likely]] {
+                return pointerOf(slot);
+            }
+            if (!live(slot) || distance(slot.key_, pos) < dist) {
+                return nullptr;
+            }
+        }
+    }
+
+    // throw when maxSize entries are indexed, e.g. before taking what the next entry points to
+    ForceInline void checkRoom() const {
+        if (size_ >= maxSize_) [[unlikely]] {
+            throw std::out_of_range("OrderIndex capacity reached");
+        }
+    }
+
+    // return false when key is already indexed
+    HintHot bool insert(uint64_t key, T *value) {
+        checkRoom();
+
+        Slot entry{key, reinterpret_cast<uint64_t>(value) | epoch_};
+        uint64_t pos = home(key);
+        for (uint64_t dist = 0;; dist++, pos = (pos + 1) & mask_) {
+            Slot &slot = slots_[pos];
+            if (!live(slot)) {
+                slot = entry;
+                ++size_;
+                return true;
+            }
+            if (slot.key_ == key && entry.key_ == key) {
+                return false;
+            }
+
+            // robin hood: the entry further from its home slot takes the place
+            const uint64_t slotDist = distance(slot.key_, pos);
+            if (slotDist < dist) {
+                std::swap(slot, entry);
+                dist = slotDist;
+            }
+        }
+    }
+
+    // return the erased value or nullptr
+    HintHot T *erase(uint64_t key) {
+        uint64_t pos = home(key);
+        for (uint64_t dist = 0;; dist++, pos = (pos + 1) & mask_) {
+            Slot &slot = slots_[pos];
+            if (!live(slot) || distance(slot.key_, pos) < dist) {
+                return nullptr;
+            }
+            if (slot.key_ == key) {
+                break;
+            }
+        }
+
+        T *value = pointerOf(slots_[pos]);
+        // backward shift deletion keeps probe sequences without tombstones
+        uint64_t next = (pos + 1) & mask_;
+        while (live(slots_[next]) && distance(slots_[next].key_, next)) {
+            slots_[pos] = slots_[next];
+            pos = next;
+            next = (next + 1) & mask_;
+        }
+        slots_[pos].value_ = 0;
+        --size_;
+        return value;
+    }
+
+   private:
+    // value_ is the pointer or-ed with the epoch, 0 when empty. trivial, the table is zero filled memory
+    struct Slot {
+        uint64_t key_;
+        uint64_t value_;
+    };
+
+    ForceInline bool live(const Slot &slot) const { return (slot.value_ & ~skPointerMask) == epoch_; }
+    ForceInline static T *pointerOf(const Slot &slot) { return reinterpret_cast<T *>(slot.value_ & skPointerMask); }
+
+    // fibonacci hashing, high bits of the product are the best mixed
+    ForceInline uint64_t home(uint64_t key) const { return (key * skHashMultiplier) >> shift_; }
+    ForceInline uint64_t distance(uint64_t key, uint64_t pos) const { return (pos - home(key)) & mask_; }
+
+   private:
+    const uint64_t capacity_;
+    const uint64_t mask_;
+    const uint32_t shift_;
+    const uint32_t maxSize_;
+    size_t size_ = 0;
+    uint64_t epoch_ = skFirstEpoch;
+    MemoryRegion region_;
+    Slot *slots_ = nullptr;
+};
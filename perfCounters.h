@@ -0,0 +1,178 @@
+#pragma once
+
+#include <cstdint>
+#include "util.h"
+
+// operations of BrokerT measured by PerfProfile
+enum class PerfOp : uint8_t { InsertOrder = 0, CancelOrder, GetOrderBook, Count };
+
+// hardware counters around broker operations, built only with -DTOB_PERF_COUNTERS (make PERF=1).
+// without it TOB_PERF_SCOPE expands to nothing and BrokerT has no profile member, so the hot paths
+// are exactly the uninstrumented ones.
+#ifdef TOB_PERF_COUNTERS
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+
+// counters of the calling thread in user space, read at once as a perf_event_open group so they cover
+// the same instructions. events the cpu or hypervisor does not expose are skipped, see has()
+struct PerfCounterGroup {
+    enum Event : uint32_t {
+        Instructions = 0,
+        Cycles,
+        BranchMisses,
+        CacheMisses,
+        L1dReadMisses,
+        L1iReadMisses,
+        PageFaults,
+        EventCount
+    };
+    static constexpr const char *skEventNames[EventCount] = {"instructions",    "cycles",          "branch-misses",
+                                                             "cache-misses",    "L1d-read-misses", "L1i-read-misses",
+                                                             "page-faults"};
+
+    struct Values {
+        uint64_t values_[EventCount] = {};
+    };
+
+    PerfCounterGroup() {
+        constexpr uint32_t constTypes[EventCount] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+                                                     PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE,
+                                                     PERF_TYPE_SOFTWARE};
+        constexpr uint64_t constConfigs[EventCount] = {
+            PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_BRANCH_MISSES,
+            PERF_COUNT_HW_CACHE_MISSES,
+            PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+            PERF_COUNT_HW_CACHE_L1I | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+            PERF_COUNT_SW_PAGE_FAULTS};
+
+        for (uint32_t event = 0; event < EventCount; event++) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = constTypes[event];
+            attr.config = constConfigs[event];
+            attr.disabled = (leaderFd_ < 0);
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+            const int fd = syscall(SYS_perf_event_open, &attr, 0, -1, leaderFd_, 0);
+            if (fd < 0) {
+                continue;
+            }
+            if (leaderFd_ < 0) {
+                leaderFd_ = fd;
+            }
+            slots_[event] = fdCount_;
+            fds_[fdCount_++] = fd;
+        }
+        if (leaderFd_ >= 0) {
+            ioctl(leaderFd_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(leaderFd_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+    }
+
+    ~PerfCounterGroup() {
+        for (uint32_t i = 0; i < fdCount_; i++) {
+            close(fds_[i]);
+        }
+    }
+
+    PerfCounterGroup(PerfCounterGroup &&) = delete;
+    PerfCounterGroup(const PerfCounterGroup &) = delete;
+    PerfCounterGroup &operator=(PerfCounterGroup &&) = delete;
+    PerfCounterGroup &operator=(const PerfCounterGroup &) = delete;
+
+    ForceInline bool available() const { return leaderFd_ >= 0; }
+    ForceInline bool has(Event event) const { return slots_[event] >= 0; }
+
+    // running totals, events which are not available stay 0
+    ForceInline void read(Values &valuesRef) const {
+        struct {
+            uint64_t count_;
+            uint64_t values_[EventCount];
+        } group;
+        if (leaderFd_ < 0 || ::read(leaderFd_, &group, sizeof(group)) <= 0) [[unlikely]] {
+            return;
+        }
+        for (uint32_t event = 0; event < EventCount; event++) {
+            valuesRef.values_[event] = (slots_[event] >= 0) ? group.values_[slots_[event]] : 0;
+        }
+    }
+
+   private:
+    int leaderFd_ = -1;
+    uint32_t fdCount_ = 0;
+    int fds_[EventCount] = {};
+    int32_t slots_[EventCount] = {-1, -1, -1, -1, -1, -1, -1};
+};
+
+// counters summed per operation type, scopes do not nest
+struct PerfProfile {
+    using EventT = PerfCounterGroup::Event;
+    static constexpr uint32_t skOpCount = static_cast<uint32_t>(PerfOp::Count);
+
+    struct OpTotals {
+        uint64_t count_ = 0;
+        uint64_t values_[PerfCounterGroup::EventCount] = {};
+    };
+
+    ForceInline const PerfCounterGroup &group() const { return group_; }
+    ForceInline const OpTotals &totals(PerfOp op) const { return totals_[static_cast<uint32_t>(op)]; }
+    void reset() {
+        for (OpTotals &totalsRef : totals_) {
+            totalsRef = OpTotals();
+        }
+    }
+
+    ForceInline void begin() { group_.read(begin_); }
+    ForceInline void end(PerfOp op) {
+        PerfCounterGroup::Values values;
+        group_.read(values);
+        OpTotals &totalsRef = totals_[static_cast<uint32_t>(op)];
+        ++totalsRef.count_;
+        for (uint32_t event = 0; event < PerfCounterGroup::EventCount; event++) {
+            totalsRef.values_[event] += values.values_[event] - begin_.values_[event];
+        }
+    }
+
+   private:
+    PerfCounterGroup group_;
+    PerfCounterGroup::Values begin_;
+    OpTotals totals_[skOpCount];
+};
+
+struct PerfScope {
+    ForceInline PerfScope(PerfProfile *profile, PerfOp op) : profile_(profile), op_(op) {
+        if (profile_) [[unlikely]] {
+            profile_->begin();
+        }
+    }
+    ForceInline ~PerfScope() {
+        if (profile_) [[unlikely]] {
+            profile_->end(op_);
+        }
+    }
+
+    PerfScope(PerfScope &&) = delete;
+    PerfScope(const PerfScope &) = delete;
+    PerfScope &operator=(PerfScope &&) = delete;
+    PerfScope &operator=(const PerfScope &) = delete;
+
+   private:
+    PerfProfile *const profile_;
+    const PerfOp op_;
+};
+
+#define TOB_PERF_SCOPE(profile, op) PerfScope perfScope_##op(profile, PerfOp::op)
+
+#else
+
+#define TOB_PERF_SCOPE(profile, op)
+
+#endif
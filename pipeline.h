@@ -0,0 +1,322 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include "eventSink.h"
+#include "message.h"
+#include "spscRing.h"
+#include "threadUtil.h"
+#include "tscClock.h"
+#include "util.h"
+
+// risk stage which accepts everything, see RiskT of Pipeline. limits checked inline on the matching thread
+// are a RiskT of BrokerT, see PreTradeRisk
+struct NoRisk {
+    ForceInline bool check(const Order &) { return true; }
+};
+
+// value of a pipeline queue and the tsc it was emitted at by the previous stage
+template <class T>
+struct Stamped {
+    T value_;
+    uint64_t tsc_ = 0;
+};
+
+// latency of a stage from the emission of its input by the previous stage to the emission of
+// its output, so queueing is included. written by the stage thread only
+struct alignas(kDefaultCacheLineSize) StageStats {
+    uint64_t count_ = 0;
+    uint64_t totalTicks_ = 0;
+    uint64_t maxTicks_ = 0;
+
+    ForceInline void record(uint64_t ticks) {
+        ++count_;
+        totalTicks_ += ticks;
+        maxTicks_ = std::max(maxTicks_, ticks);
+    }
+};
+
+struct PipelineConfig {
+    // cores of the decode, risk, match and publish stages, a negative core leaves the stage unpinned
+    int32_t cores_[4] = {-1, -1, -1, -1};
+    // values a stage takes from its input queue and pushes to its output queue at once
+    uint32_t batchSize_ = 16;
+};
+
+// decode -> risk -> match -> publish, each stage is a thread busy polling on its own core and the
+// stages are connected by SpscRing, so matching never waits for decoding or publishing.
+//  decode: InsertOrder from the gateway into Order
+//  risk: RiskT::check(const Order &), a rejected order goes on with Rejected status and is only reported
+//  match: the broker, built by the match thread so it is local to its core, accepted orders of a batch go
+//      through insertOrders and rejected ones through rejectOrder in the order they came, the events of the
+//      batch and one book delta are passed on
+//  publish: PublishT::onEvent(const BrokerEvent &) and PublishT::onBookDelta(const OrderbookDelta<N> &)
+// the broker sink must be an EventRing holding the events of a whole batch, see skBatchEvents. a batch
+// sweeping more resting orders overruns it, EventRing::overrun() of broker().sink() counts the lost events.
+// submit() is called by a single producer thread, risk() and publisher() may be used before the
+// first submit() and after stop().
+template <class BrokerImplT, class RiskT, class PublishT, uint32_t kQueueSize = 4096>
+struct Pipeline {
+    enum Stage : uint32_t { Decode = 0, Risk, Match, Publish, StageCount };
+
+    static constexpr uint32_t skMaxBatch = 256;
+    // an order is reported once when it rests, is canceled or rejected, and fills each resting order it
+    // meets with a trade and two reports. the sink holds a batch of orders filling skSweptOrders each
+    static constexpr uint32_t skSweptOrders = 16;
+    static constexpr uint32_t skBatchEvents = skMaxBatch * (1 + 3 * skSweptOrders);
+    using SinkT = std::remove_reference_t<decltype(std::declval<BrokerImplT &>().sink())>;
+    static_assert(SinkT::skCapacity >= skBatchEvents, "the broker EventRing must hold the events of a batch");
+    using DeltaT = OrderbookDelta<BrokerImplT::skBookDepth>;
+
+    explicit Pipeline(const PipelineConfig &config) : batchSize_(std::clamp(config.batchSize_, 1u, skMaxBatch)) {
+        threads_[Decode] = std::thread([this, core = config.cores_[Decode]] {
+            pinCurrentThread(core);
+            runDecode();
+        });
+        threads_[Risk] = std::thread([this, core = config.cores_[Risk]] {
+            pinCurrentThread(core);
+            runRisk();
+        });
+        threads_[Match] = std::thread([this, core = config.cores_[Match]] {
+            pinCurrentThread(core);
+            broker_ = std::make_unique<BrokerImplT>();
+            ready_.store(true, std::memory_order_release);
+            runMatch();
+        });
+        threads_[Publish] = std::thread([this, core = config.cores_[Publish]] {
+            pinCurrentThread(core);
+            runPublish();
+        });
+        while (!ready_.load(std::memory_order_acquire)) {
+            cpuRelax();
+        }
+    }
+
+    ~Pipeline() { stop(); }
+
+    Pipeline(Pipeline &&) = delete;
+    Pipeline(const Pipeline &) = delete;
+    Pipeline &operator=(Pipeline &&) = delete;
+    Pipeline &operator=(const Pipeline &) = delete;
+
+    RiskT &risk() { return risk_; }
+    PublishT &publisher() { return publisher_; }
+    // only after stop()
+    BrokerImplT &broker() { return *broker_; }
+    const StageStats &stats(Stage stage) const { return stats_[stage]; }
+
+    // producer, spin while the decode queue is full
+    HintHot void submit(const InsertOrder &message) {
+        const Stamped<InsertOrder> constStamped{message, clock_.rdTsc()};
+        while (!input_.tryPush(constStamped)) [[unlikely]] {
+            cpuRelax();
+        }
+    }
+
+    // producer, let the stages process everything submitted then join them
+    void stop() {
+        if (stopped_) {
+            return;
+        }
+        stopped_ = true;
+        closed_.store(true, std::memory_order_release);
+        for (auto &thread : threads_) {
+            thread.join();
+        }
+    }
+
+   private:
+    // values pushed to the next queue at once, a full queue is waited for
+    template <class T, uint32_t kSize>
+    struct Output {
+        SpscRing<T, kSize> &queue_;
+        T values_[skMaxBatch];
+        uint32_t size_ = 0;
+
+        // fill next() in place then commit() it
+        ForceInline T &next() { return values_[size_]; }
+        ForceInline void commit() {
+            if (++size_ == skMaxBatch) [[unlikely]] {
+                flush();
+            }
+        }
+
+        ForceInline void emit(const T &value) {
+            next() = value;
+            commit();
+        }
+
+        ForceInline void flush() {
+            for (size_t pushed = 0; pushed < size_;) {
+                const size_t constCount = queue_.push(values_ + pushed, size_ - pushed);
+                if (!constCount) {
+                    cpuRelax();
+                }
+                pushed += constCount;
+            }
+            size_ = 0;
+        }
+    };
+
+    // poll the input queue until the upstream stage is done and the queue is empty,
+    // fn(const T &) handles each value, flush() ends a batch
+    template <class T, uint32_t kSize, class F, class FlushF>
+    void poll(Stage stage, SpscRing<T, kSize> &input, const std::atomic<bool> &upstreamDone, F &&fn,
+              FlushF &&flush) {
+        while (true) {
+            if (input.consume(fn, batchSize_)) [[likely]] {
+                flush();
+                continue;
+            }
+            if (upstreamDone.load(std::memory_order_acquire) && input.empty()) {
+                break;
+            }
+            cpuRelax();
+        }
+        done_[stage].store(true, std::memory_order_release);
+    }
+
+    void runDecode() {
+        auto output = std::make_unique<Output<Stamped<Order>, kQueueSize>>(decoded_);
+        StageStats &statsRef = stats_[Decode];
+        poll(
+            Decode, input_, closed_,
+            [&](const Stamped<InsertOrder> &stamped) {
+                const InsertOrder &message = stamped.value_;
+                Stamped<Order> &outRef = output->next();
+                Order &orderRef = outRef.value_;
+                orderRef.coid_ = message.coid_.value_;
+                orderRef.sid_ = message.sid_;
+                orderRef.side_ = message.side_;
+                orderRef.orderStatus_ = OrderStatus::New;
+                orderRef.type_ = message.type_;
+                orderRef.offset_ = message.offset_;
+                orderRef.tif_ = message.tif_;
+                orderRef.price_ = message.price_;
+                orderRef.qty_ = orderRef.remainQty_ = message.qty_;
+                orderRef.createTimeNs_ = message.tsNs_;
+                outRef.tsc_ = clock_.rdTsc();
+                statsRef.record(outRef.tsc_ - stamped.tsc_);
+                output->commit();
+            },
+            [&] { output->flush(); });
+    }
+
+    void runRisk() {
+        auto output = std::make_unique<Output<Stamped<Order>, kQueueSize>>(checked_);
+        StageStats &statsRef = stats_[Risk];
+        poll(
+            Risk, decoded_, done_[Decode],
+            [&](const Stamped<Order> &stamped) {
+                Stamped<Order> &outRef = output->next();
+                outRef.value_ = stamped.value_;
+                if (!risk_.check(outRef.value_)) [[unlikely]] {
+                    outRef.value_.orderStatus_ = OrderStatus::Rejected;
+                }
+                outRef.tsc_ = clock_.rdTsc();
+                statsRef.record(outRef.tsc_ - stamped.tsc_);
+                output->commit();
+            },
+            [&] { output->flush(); });
+    }
+
+    void runMatch() {
+        auto events = std::make_unique<Output<Stamped<BrokerEvent>, kQueueSize>>(events_);
+        auto orders = std::make_unique<Order[]>(skMaxBatch);
+        uint64_t inputTsc[skMaxBatch];
+        // values of the batch, accepted orders of the batch and those of them already inserted
+        uint32_t count = 0;
+        uint32_t size = 0;
+        uint32_t inserted = 0;
+        StageStats &statsRef = stats_[Match];
+        DeltaT delta;
+
+        const auto constInsert = [&] {
+            if (inserted < size) {
+                broker_->insertOrders(std::span<const Order>(orders.get() + inserted, size - inserted));
+                inserted = size;
+            }
+        };
+
+        poll(
+            Match, checked_, done_[Risk],
+            [&](const Stamped<Order> &stamped) {
+                inputTsc[count++] = stamped.tsc_;
+                if (stamped.value_.orderStatus_ == OrderStatus::Rejected) [[unlikely]] {
+                    // the accepted orders ahead of it are matched first, so its report keeps its place
+                    constInsert();
+                    broker_->rejectOrder(stamped.value_);
+                    return;
+                }
+                orders[size++] = stamped.value_;
+            },
+            [&] {
+                constInsert();
+                broker_->getOrderBookDelta(delta);
+
+                const uint64_t constTsc = clock_.rdTsc();
+                broker_->sink().drain([&](const BrokerEvent &event) { events->emit({event, constTsc}); });
+                events->flush();
+                if (delta.updateSize_) {
+                    const Stamped<DeltaT> constStamped{delta, constTsc};
+                    while (!deltas_.tryPush(constStamped)) {
+                        cpuRelax();
+                    }
+                }
+                for (uint32_t i = 0; i < count; i++) {
+                    statsRef.record(constTsc - inputTsc[i]);
+                }
+                count = size = inserted = 0;
+            });
+    }
+
+    void runPublish() {
+        StageStats &statsRef = stats_[Publish];
+        const auto constOnEvent = [&](const Stamped<BrokerEvent> &stamped) {
+            publisher_.onEvent(stamped.value_);
+            statsRef.record(clock_.rdTsc() - stamped.tsc_);
+        };
+        const auto constOnDelta = [&](const Stamped<DeltaT> &stamped) { publisher_.onBookDelta(stamped.value_); };
+
+        while (true) {
+            const size_t constCount =
+                events_.consume(constOnEvent, batchSize_) + deltas_.consume(constOnDelta, batchSize_);
+            if (constCount) [[likely]] {
+                continue;
+            }
+            if (done_[Match].load(std::memory_order_acquire) && events_.empty() && deltas_.empty()) {
+                break;
+            }
+            cpuRelax();
+        }
+    }
+
+   private:
+    const uint32_t batchSize_;
+    TscClock &clock_ = TscClock::getInstance();
+
+    SpscRing<Stamped<InsertOrder>, kQueueSize> input_;
+    SpscRing<Stamped<Order>, kQueueSize> decoded_;
+    SpscRing<Stamped<Order>, kQueueSize> checked_;
+    SpscRing<Stamped<BrokerEvent>, kQueueSize> events_;
+    SpscRing<Stamped<DeltaT>, kQueueSize / 16> deltas_;
+
+    RiskT risk_;
+    PublishT publisher_;
+    std::unique_ptr<BrokerImplT> broker_;
+
+    // closed_ is set by stop(), done_ by each stage once its input is drained
+    std::atomic<bool> closed_{false};
+    std::atomic<bool> done_[StageCount] = {};
+    std::atomic<bool> ready_{false};
+    bool stopped_ = false;
+
+    StageStats stats_[StageCount];
+    std::thread threads_[StageCount];
+};
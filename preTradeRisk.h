@@ -0,0 +1,228 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include "bookSide.h"
+#include "hotOrder.h"
+#include "message.h"
+#include "tickScale.h"
+#include "util.h"
+
+// Broker runs its RiskT inline on the matching thread right before an incoming order is matched:
+//  check(const HotOrder &, Price bestBid, Price bestAsk): false rejects the order, the remaining qty of a
+//  market order about to rest at its protection bound is checked again as a limit order
+//  checkAmend(const HotOrder &, Qty delta, Price bestBid, Price bestAsk): false rejects an amend of a resting
+//  order to the price and remaining qty of the order, delta is the change of its remaining qty
+// and keeps it up to date with the resting orders and fills of every trader:
+//  onRest(coid, side, qty) / onAmend(coid, side, delta) / onRemove(coid, side, remainQty)
+//  onFill(coid, side, qty, resting) for both orders of a trade
+//  onReset(): every resting order is gone, see BrokerT::reset
+// NullRisk compiles all of it away.
+
+// trader of an order, the low 16 bits of the combined account of its client order id
+ForceInline uint16_t traderOf(uint64_t coid) {
+    return uCombinedAcctID(ClientOrderID(coid).breakdown.combAcctID_).breakdown.traderID_;
+}
+
+struct NullRisk {
+    static constexpr bool skEnabled = false;
+
+    ForceInline bool check(const HotOrder &, Price, Price) { return true; }
+    ForceInline bool checkAmend(const HotOrder &, Qty, Price, Price) { return true; }
+    ForceInline void onRest(uint64_t, QuoteType, Qty) {}
+    ForceInline void onAmend(uint64_t, QuoteType, Qty) {}
+    ForceInline void onRemove(uint64_t, QuoteType, Qty) {}
+    ForceInline void onFill(uint64_t, QuoteType, Qty, bool) {}
+    ForceInline void onReset() {}
+};
+
+// limits of one trader, qty in lots and notional in ticks * lots
+struct RiskLimits {
+    // filled position plus the open qty of the resting orders and the order itself on its side,
+    // i.e. the position if every order of that side was filled, both long and short
+    int64_t maxPosition_ = std::numeric_limits<int64_t>::max();
+    // price * qty of one order, a market order is valued at the opposite best price
+    int64_t maxOrderNotional_ = std::numeric_limits<int64_t>::max();
+    // resting orders, checked for limit orders
+    uint32_t maxOpenOrders_ = std::numeric_limits<uint32_t>::max();
+};
+
+struct RiskConfig {
+    // of every trader until PreTradeRisk::setLimits
+    RiskLimits limits_;
+    // trader ids below traders_ have a row, orders of the other ones are rejected. at most 1 << 16,
+    // a row is a cache line
+    uint32_t traders_ = 1 << 16;
+    // a limit order priced more than bandBps_ basis points through the opposite best price is rejected,
+    // the band is rounded up to whole ticks and at least one tick (see bandTicks), 0 disables it
+    int64_t bandBps_ = 0;
+};
+
+// limits and state of a trader share one cache line, a check reads that line only
+struct alignas(kDefaultCacheLineSize) TraderRisk {
+    RiskLimits limits_;
+    int64_t position_ = 0;
+    int64_t openBuyQty_ = 0;
+    int64_t openSellQty_ = 0;
+    uint32_t openOrders_ = 0;
+    // in the touched list of PreTradeRisk
+    bool touched_ = false;
+};
+static_assert(sizeof(TraderRisk) == kDefaultCacheLineSize, "one cache line per trader");
+
+// pre-trade limits of every trader, in a flat array indexed by the trader id of the client order id:
+// no hashing and no locks, it is owned by the matching thread like its broker.
+// the traders which had a resting order since the last reset are listed, so onReset() clears only them
+struct PreTradeRisk {
+    static constexpr bool skEnabled = true;
+    static constexpr uint32_t skMaxTraders = 1 << 16;
+
+    enum Reason : uint32_t { Position = 0, Notional, OpenOrders, PriceBand, UnknownTrader, ReasonCount };
+
+    explicit PreTradeRisk(const RiskConfig &config = RiskConfig()) { configure(config); }
+
+    PreTradeRisk(PreTradeRisk &&) = delete;
+    PreTradeRisk(const PreTradeRisk &) = delete;
+    PreTradeRisk &operator=(PreTradeRisk &&) = delete;
+    PreTradeRisk &operator=(const PreTradeRisk &) = delete;
+
+    // the band and the limits of every trader, positions and open orders are kept unless the table is
+    // resized, which is only allowed before any order rested or right after onReset()
+    void configure(const RiskConfig &config) {
+        if (!config.traders_ || config.traders_ > skMaxTraders) {
+            throw std::invalid_argument("RiskConfig traders out of range");
+        }
+        if (config.traders_ != traderCount_) {
+            if (touchedCount_) {
+                throw std::logic_error("PreTradeRisk resized with resting orders");
+            }
+            traders_ = std::make_unique<TraderRisk[]>(config.traders_);
+            touched_ = std::make_unique<uint16_t[]>(config.traders_);
+            traderCount_ = config.traders_;
+        }
+        bandBps_ = config.bandBps_;
+        for (uint32_t i = 0; i < traderCount_; i++) {
+            traders_[i].limits_ = config.limits_;
+        }
+    }
+
+    void setLimits(uint16_t trader, const RiskLimits &limits) { traders_[trader].limits_ = limits; }
+    void setBand(int64_t bandBps) { bandBps_ = bandBps; }
+
+    // trader below traderCount()
+    ForceInline const TraderRisk &trader(uint16_t trader) const { return traders_[trader]; }
+    ForceInline uint32_t traderCount() const { return traderCount_; }
+    ForceInline uint64_t rejects(Reason reason) const { return rejects_[reason]; }
+
+    HintHot bool check(const HotOrder &order, Price bestBid, Price bestAsk) {
+        return checkOrder<true>(order, order.remainQty_, bestBid, bestAsk);
+    }
+
+    // the amended order is open already, it adds delta to the open qty and nothing to the open orders
+    HintHot bool checkAmend(const HotOrder &order, Qty delta, Price bestBid, Price bestAsk) {
+        return checkOrder<false>(order, delta, bestBid, bestAsk);
+    }
+
+    ForceInline void onRest(uint64_t coid, QuoteType side, Qty qty) {
+        const uint16_t constTrader = traderOf(coid);
+        TraderRisk &traderRef = traders_[constTrader];
+        if (!traderRef.touched_) [[unlikely]] {
+            traderRef.touched_ = true;
+            touched_[touchedCount_++] = constTrader;
+        }
+        ++traderRef.openOrders_;
+        openQty(traderRef, side) += qty;
+    }
+
+    ForceInline void onAmend(uint64_t coid, QuoteType side, Qty delta) {
+        openQty(traders_[traderOf(coid)], side) += delta;
+    }
+
+    ForceInline void onRemove(uint64_t coid, QuoteType side, Qty remainQty) {
+        TraderRisk &traderRef = traders_[traderOf(coid)];
+        --traderRef.openOrders_;
+        openQty(traderRef, side) -= remainQty;
+    }
+
+    // resting: the filled order is a resting one whose open qty goes into the position
+    ForceInline void onFill(uint64_t coid, QuoteType side, Qty qty, bool resting) {
+        TraderRisk &traderRef = traders_[traderOf(coid)];
+        traderRef.position_ += (side == QuoteType::Buy) ? qty : -qty;
+        if (resting) {
+            openQty(traderRef, side) -= qty;
+        }
+    }
+
+    // positions and limits are kept, only the touched traders are visited
+    void onReset() {
+        for (uint32_t i = 0; i < touchedCount_; i++) {
+            TraderRisk &traderRef = traders_[touched_[i]];
+            traderRef.openBuyQty_ = traderRef.openSellQty_ = 0;
+            traderRef.openOrders_ = 0;
+            traderRef.touched_ = false;
+        }
+        touchedCount_ = 0;
+    }
+
+   private:
+    // addedQty: what the order adds to the open qty of its side, kNew: it adds an open order
+    template <bool kNew>
+    ForceInline bool checkOrder(const HotOrder &order, Qty addedQty, Price bestBid, Price bestAsk) {
+        const uint16_t constTrader = traderOf(order.coid_);
+        if (constTrader >= traderCount_) [[unlikely]] {
+            return reject(UnknownTrader);
+        }
+        const TraderRisk &traderRef = traders_[constTrader];
+        const RiskLimits &limitsRef = traderRef.limits_;
+        const bool constBuy = (order.side_ == QuoteType::Buy);
+        const bool constMarket = (order.type_ == OrderType::Market);
+        const Price constOpposite = constBuy ? bestAsk : bestBid;
+        const bool constHasOpposite = constBuy ? (bestAsk != SideTraits<QuoteType::Sell>::skWorstPrice)
+                                               : (bestBid != SideTraits<QuoteType::Buy>::skWorstPrice);
+
+        const int64_t constExposure = constBuy ? traderRef.position_ + traderRef.openBuyQty_ + addedQty
+                                               : traderRef.openSellQty_ + addedQty - traderRef.position_;
+        if (constExposure > limitsRef.maxPosition_) [[unlikely]] {
+            return reject(Position);
+        }
+
+        const Price constValuePrice = constMarket ? (constHasOpposite ? constOpposite : 0) : order.price_;
+        if (constValuePrice * order.remainQty_ > limitsRef.maxOrderNotional_) [[unlikely]] {
+            return reject(Notional);
+        }
+        if (constMarket) {
+            return true;
+        }
+
+        if (kNew && traderRef.openOrders_ >= limitsRef.maxOpenOrders_) [[unlikely]] {
+            return reject(OpenOrders);
+        }
+        if (bandBps_ && constHasOpposite) {
+            const Price constBand = bandTicks(constOpposite, bandBps_);
+            if (constBuy ? (order.price_ > constOpposite + constBand) : (order.price_ < constOpposite - constBand))
+                [[unlikely]] {
+                return reject(PriceBand);
+            }
+        }
+        return true;
+    }
+
+    ForceInline static int64_t &openQty(TraderRisk &traderRef, QuoteType side) {
+        return (side == QuoteType::Buy) ? traderRef.openBuyQty_ : traderRef.openSellQty_;
+    }
+
+    HintCold NoInline bool reject(Reason reason) {
+        ++rejects_[reason];
+        return false;
+    }
+
+   private:
+    int64_t bandBps_ = 0;
+    uint64_t rejects_[ReasonCount] = {};
+    uint32_t traderCount_ = 0;
+    uint32_t touchedCount_ = 0;
+    std::unique_ptr<TraderRisk[]> traders_;
+    std::unique_ptr<uint16_t[]> touched_;
+};
@@ -0,0 +1,252 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include "hotOrder.h"
+#include "message.h"
+#include "orderCsvParser.h"
+#include "threadUtil.h"
+#include "tickScale.h"
+#include "tscClock.h"
+#include "util.h"
+
+// binary order flow file: a ReplayHeader then fixed size ReplayRecord, all in host byte order.
+// records are replayed straight from the mapping, so a trading day is read at memory bandwidth
+// without any parsing.
+
+enum class ReplayEventType : uint8_t { Unknown = 0, Insert, Cancel };
+
+// price_ is in ticks of the TickScale of the header, a cancel only needs coid_
+struct ReplayRecord {
+    Nanoseconds tsNs_ = 0;
+    uint64_t coid_ = 0;
+    Price price_ = 0;
+    Qty qty_ = 0;
+    ReplayEventType event_ = ReplayEventType::Unknown;
+    QuoteType side_ = QuoteType::Unknown;
+    OrderType type_ = OrderType::Unknown;
+    TimeInForce tif_ = TimeInForce::Unknown;
+};
+static_assert(sizeof(ReplayRecord) == 32, "records are 32 bytes, two per cache line");
+
+struct alignas(kDefaultCacheLineSize) ReplayHeader {
+    static constexpr uint64_t skMagic = 0x59414C5052424F54ull;  // "TOBRPLAY"
+    static constexpr uint32_t skVersion = 1;
+
+    uint64_t magic_ = skMagic;
+    uint32_t version_ = skVersion;
+    uint32_t recordSize_ = sizeof(ReplayRecord);
+    uint64_t recordCount_ = 0;
+    int64_t scale_ = 0;
+    int64_t tickSize_ = 0;
+    Nanoseconds firstTsNs_ = 0;
+    Nanoseconds lastTsNs_ = 0;
+};
+static_assert(sizeof(ReplayHeader) == kDefaultCacheLineSize, "records start on a cache line");
+
+inline void toOrder(const ReplayRecord &record, Order &orderRef) {
+    orderRef.coid_ = record.coid_;
+    orderRef.side_ = record.side_;
+    orderRef.orderStatus_ = (record.event_ == ReplayEventType::Cancel) ? OrderStatus::Canceled : OrderStatus::New;
+    orderRef.type_ = record.type_;
+    orderRef.tif_ = record.tif_;
+    orderRef.price_ = record.price_;
+    orderRef.qty_ = orderRef.remainQty_ = record.qty_;
+    orderRef.createTimeNs_ = record.tsNs_;
+}
+
+// what the broker matches on of an insert record, without going through the 81 bytes of Order
+inline void toHot(const ReplayRecord &record, HotOrder &hotRef) {
+    hotRef.coid_ = record.coid_;
+    hotRef.price_ = record.price_;
+    hotRef.qty_ = hotRef.remainQty_ = record.qty_;
+    hotRef.side_ = record.side_;
+    hotRef.type_ = record.type_;
+    hotRef.tif_ = record.tif_;
+    hotRef.orderStatus_ = OrderStatus::New;
+}
+
+inline void toRecord(const Order &order, ReplayRecord &recordRef) {
+    recordRef.tsNs_ = order.createTimeNs_;
+    recordRef.coid_ = order.coid_;
+    recordRef.price_ = order.price_;
+    recordRef.qty_ = order.qty_;
+    recordRef.event_ = (order.orderStatus_ == OrderStatus::Canceled) ? ReplayEventType::Cancel : ReplayEventType::Insert;
+    recordRef.side_ = order.side_;
+    recordRef.type_ = order.type_;
+    recordRef.tif_ = order.tif_;
+}
+
+// appends records to a new file, the header is written by close()
+struct ReplayWriter {
+    ReplayWriter(const std::string &path, const TickScale &tickScale) : out_(path, std::ios::binary | std::ios::trunc) {
+        if (!out_) {
+            throw std::runtime_error("failed to create " + path);
+        }
+        header_.scale_ = tickScale.scale_;
+        header_.tickSize_ = tickScale.tickSize_;
+        out_.write(reinterpret_cast<const char *>(&header_), sizeof(header_));
+    }
+
+    ~ReplayWriter() {
+        if (out_.is_open()) {
+            close();
+        }
+    }
+
+    ReplayWriter(ReplayWriter &&) = delete;
+    ReplayWriter(const ReplayWriter &) = delete;
+    ReplayWriter &operator=(ReplayWriter &&) = delete;
+    ReplayWriter &operator=(const ReplayWriter &) = delete;
+
+    ForceInline uint64_t recordCount() const { return header_.recordCount_; }
+
+    void append(const ReplayRecord &record) {
+        if (!header_.recordCount_++) {
+            header_.firstTsNs_ = record.tsNs_;
+        }
+        header_.lastTsNs_ = record.tsNs_;
+        out_.write(reinterpret_cast<const char *>(&record), sizeof(record));
+    }
+
+    void close() {
+        out_.seekp(0);
+        out_.write(reinterpret_cast<const char *>(&header_), sizeof(header_));
+        out_.close();
+        if (out_.fail()) {
+            throw std::runtime_error("failed to write replay file");
+        }
+    }
+
+   private:
+    std::ofstream out_;
+    ReplayHeader header_;
+};
+
+// convert the order csv of readme.txt into a replay file, see OrderCsvParser, return the number of records
+inline uint64_t convertCsvToReplay(const std::string &csvPath, const std::string &replayPath,
+                                   const TickScale &tickScale) {
+    OrderCsvParser parser(tickScale);
+    ReplayWriter writer(replayPath, tickScale);
+    ReplayRecord record;
+    parser.parseFile(csvPath, [&](std::span<const Order> orders) {
+        for (const Order &order : orders) {
+            toRecord(order, record);
+            writer.append(record);
+        }
+    });
+    writer.close();
+    return writer.recordCount();
+}
+
+// read only mapping of a replay file
+struct ReplayFile {
+    explicit ReplayFile(const std::string &path) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("failed to open " + path);
+        }
+        struct stat st;
+        void *base = fstat(fd, &st) ? MAP_FAILED : mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED) {
+            throw std::runtime_error("failed to map " + path);
+        }
+        base_ = base;
+        size_ = st.st_size;
+
+        header_ = static_cast<const ReplayHeader *>(base);
+        if (size_ < sizeof(ReplayHeader) || header_->magic_ != ReplayHeader::skMagic ||
+            header_->version_ != ReplayHeader::skVersion || header_->recordSize_ != sizeof(ReplayRecord) ||
+            size_ < sizeof(ReplayHeader) + header_->recordCount_ * sizeof(ReplayRecord)) {
+            munmap(base_, size_);
+            throw std::runtime_error("unexpected layout of " + path);
+        }
+        madvise(base_, size_, MADV_SEQUENTIAL | MADV_WILLNEED);
+    }
+
+    ~ReplayFile() { munmap(base_, size_); }
+
+    ReplayFile(ReplayFile &&) = delete;
+    ReplayFile(const ReplayFile &) = delete;
+    ReplayFile &operator=(ReplayFile &&) = delete;
+    ReplayFile &operator=(const ReplayFile &) = delete;
+
+    ForceInline const ReplayHeader &header() const { return *header_; }
+    ForceInline TickScale tickScale() const { return TickScale(header_->scale_, header_->tickSize_); }
+    ForceInline std::span<const ReplayRecord> records() const {
+        return {reinterpret_cast<const ReplayRecord *>(header_ + 1), header_->recordCount_};
+    }
+
+   private:
+    void *base_ = nullptr;
+    size_t size_ = 0;
+    const ReplayHeader *header_ = nullptr;
+};
+
+enum class ReplayPace : uint8_t { AsFastAsPossible = 0, Recorded };
+
+struct ReplayStats {
+    uint64_t inserts_ = 0;
+    uint64_t cancels_ = 0;
+    uint64_t elapsedTicks_ = 0;
+    // Recorded pace only, events which could not be fed at their recorded time
+    uint64_t lateEvents_ = 0;
+    uint64_t maxLateTicks_ = 0;
+};
+
+// feed every record to the broker, an insert goes in as the HotOrder of the mapped record. Recorded keeps
+// the recorded time between events (relative to the first one) by spinning on the tsc.
+// afterEvent(const ReplayRecord &) runs after each record, e.g. to drain the broker sink
+template <class BrokerImplT, class F>
+ReplayStats replay(const ReplayFile &file, BrokerImplT &broker, ReplayPace pace, F &&afterEvent) {
+    TscClock &clock = TscClock::getInstance();
+    const std::span<const ReplayRecord> constRecords = file.records();
+    const Nanoseconds constFirstTsNs = file.header().firstTsNs_;
+
+    ReplayStats stats;
+    HotOrder order;
+    const uint64_t constBeginTick = clock.rdTsc();
+    for (const ReplayRecord &record : constRecords) {
+        if (pace == ReplayPace::Recorded) {
+            const Nanoseconds constOffsetNs = (record.tsNs_ > constFirstTsNs) ? record.tsNs_ - constFirstTsNs : 0;
+            const uint64_t constDueTick = constBeginTick + clock.ns2Tsc(constOffsetNs);
+            uint64_t nowTick = clock.rdTsc();
+            if (nowTick > constDueTick) {
+                ++stats.lateEvents_;
+                stats.maxLateTicks_ = std::max(stats.maxLateTicks_, nowTick - constDueTick);
+            }
+            while (nowTick < constDueTick) {
+                cpuRelax();
+                nowTick = clock.rdTsc();
+            }
+        }
+
+        if (record.event_ == ReplayEventType::Cancel) [[unlikely]] {
+            broker.cancelOrder(record.coid_);
+            ++stats.cancels_;
+        } else {
+            toHot(record, order);
+            broker.insertOrder(order);
+            ++stats.inserts_;
+        }
+        afterEvent(record);
+    }
+    stats.elapsedTicks_ = clock.rdTsc() - constBeginTick;
+    return stats;
+}
+
+template <class BrokerImplT>
+ForceInline ReplayStats replay(const ReplayFile &file, BrokerImplT &broker,
+                               ReplayPace pace = ReplayPace::AsFastAsPossible) {
+    return replay(file, broker, pace, [](const ReplayRecord &) {});
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include "message.h"
+#include "threadUtil.h"
+#include "util.h"
+
+// latest value of a single writer for any number of reader threads, T is trivially copyable.
+// two slots each guarded by its own sequence (odd while written), the writer fills the slot not
+// published last then publishes its version, so a reader copying the latest slot only retries when
+// the writer went through both slots during the copy. the writer never waits for readers and only
+// writes lines readers are reading when they lag a whole publish behind.
+// lock free atomics keep it usable in memory shared between processes.
+template <class T>
+struct SeqlockValue {
+    SeqlockValue() = default;
+    SeqlockValue(SeqlockValue &&) = delete;
+    SeqlockValue(const SeqlockValue &) = delete;
+    SeqlockValue &operator=(SeqlockValue &&) = delete;
+    SeqlockValue &operator=(const SeqlockValue &) = delete;
+
+    // writer, fn(T &) fills the value in place
+    template <class F>
+    HintHot void publish(F &&fn) {
+        const uint64_t constVersion = version_.load(std::memory_order_relaxed) + 1;
+        Slot &slot = slots_[constVersion & 1];
+        const uint64_t constSeq = slot.seq_.load(std::memory_order_relaxed);
+        slot.seq_.store(constSeq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        fn(slot.value_);
+        slot.seq_.store(constSeq + 2, std::memory_order_release);
+        version_.store(constVersion, std::memory_order_release);
+    }
+
+    ForceInline void publish(const T &value) {
+        publish([&](T &valueRef) { std::memcpy(&valueRef, &value, sizeof(T)); });
+    }
+
+    // number of values published so far
+    ForceInline uint64_t version() const { return version_.load(std::memory_order_acquire); }
+
+    // reader, copy the latest value, return its version, 0 when nothing was published yet
+    HintHot uint64_t read(T &value) const {
+        while (true) {
+            const uint64_t constVersion = version_.load(std::memory_order_acquire);
+            const Slot &slot = slots_[constVersion & 1];
+            const uint64_t constSeq = slot.seq_.load(std::memory_order_acquire);
+            if (constSeq & 1) [[unlikely]] {
+                cpuRelax();
+                continue;
+            }
+            std::memcpy(&value, &slot.value_, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq_.load(std::memory_order_relaxed) == constSeq) [[likely]] {
+                return constVersion;
+            }
+        }
+    }
+
+   private:
+    struct alignas(kDefaultCacheLineSize) Slot {
+        std::atomic<uint64_t> seq_{0};
+        T value_;
+    };
+
+    alignas(kDefaultCacheLineSize) std::atomic<uint64_t> version_{0};
+    Slot slots_[2];
+};
+
+// latest Orderbook<N> of the matching thread, see BrokerT::publishOrderBook
+template <size_t N>
+using SeqlockBook = SeqlockValue<Orderbook<N>>;
@@ -0,0 +1,322 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include "eventSink.h"
+#include "message.h"
+#include "seqlockBook.h"
+#include "util.h"
+
+// market data broadcast ring in shared memory (shm_open, so /dev/shm on linux) for consumers in other
+// processes: one writer, any number of readers which never write to the mapping.
+// a record is one cache line holding a Trade or one level update of a book delta, records carry the
+// sequence number 1, 2, 3... of the writer. the writer never waits, a reader more than the ring
+// capacity behind finds newer sequence numbers in its slots (overrun) and resyncs from the snapshot
+// of the book the writer publishes every snapshotInterval records.
+
+enum class BusRecordType : uint8_t { Unknown = 0, Trade, Level };
+
+// update of one level of a book delta, bidSize_ and askSize_ are the sizes after the delta,
+// last_ marks the last update of a delta so the book is consistent
+struct BusLevel {
+    QuoteType side_ = QuoteType::Unknown;
+    uint8_t rank_ = 0;
+    uint8_t last_ = 0;
+    uint16_t bidSize_ = 0;
+    uint16_t askSize_ = 0;
+    PriceLevel level_;
+} __attribute__((packed));
+
+// seq_ is 0 while the writer fills the slot and the sequence number of the record once done
+struct alignas(kDefaultCacheLineSize) BusRecord {
+    std::atomic<uint64_t> seq_{0};
+    BusRecordType type_ = BusRecordType::Unknown;
+    union {
+        Trade trade_;
+        BusLevel level_;
+    };
+
+    BusRecord() : trade_() {}
+};
+static_assert(sizeof(BusRecord) == kDefaultCacheLineSize, "a record is one cache line");
+
+// book including every record up to seq_
+template <size_t N>
+struct BusSnapshot {
+    uint64_t seq_ = 0;
+    Orderbook<N> book_;
+};
+
+template <size_t N>
+struct BusHeader {
+    static constexpr uint64_t skMagic = 0x5355424B4F4F42ull;  // "BOOKBUS"
+    static constexpr uint32_t skLayoutVersion = 1;
+
+    uint64_t magic_ = skMagic;
+    uint32_t layoutVersion_ = skLayoutVersion;
+    uint32_t depth_ = N;
+    uint64_t capacity_ = 0;
+    uint64_t snapshotInterval_ = 0;
+
+    // last published sequence number
+    alignas(kDefaultCacheLineSize) std::atomic<uint64_t> writeSeq_{0};
+    SeqlockValue<BusSnapshot<N>> snapshot_;
+};
+
+template <size_t N>
+struct ShmBusWriter {
+    using HeaderT = BusHeader<N>;
+    using DeltaT = OrderbookDelta<N>;
+
+    // capacity: records in the ring, power of 2, snapshotInterval: records between two snapshots,
+    // at most half the capacity so that a resyncing reader finds the records following the snapshot
+    ShmBusWriter(const std::string &name, uint64_t capacity, uint64_t snapshotInterval)
+        : name_(name), mask_(capacity - 1), snapshotInterval_(snapshotInterval) {
+        if (!capacity || (capacity & mask_) || !snapshotInterval || snapshotInterval > capacity / 2) {
+            throw std::invalid_argument("ShmBusWriter capacity must be power of 2 and at least twice snapshotInterval");
+        }
+
+        size_ = sizeof(HeaderT) + capacity * sizeof(BusRecord);
+        const int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+        if (fd < 0) {
+            throw std::runtime_error("shm_open failed for " + name);
+        }
+        const bool constSized = !ftruncate(fd, size_);
+        void *base = constSized ? mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        close(fd);
+        if (base == MAP_FAILED) {
+            shm_unlink(name.c_str());
+            throw std::runtime_error("failed to map " + name);
+        }
+
+        header_ = new (base) HeaderT();
+        records_ = new (static_cast<char *>(base) + sizeof(HeaderT)) BusRecord[capacity];
+        header_->capacity_ = capacity;
+        header_->snapshotInterval_ = snapshotInterval;
+    }
+
+    ~ShmBusWriter() {
+        munmap(header_, size_);
+        shm_unlink(name_.c_str());
+    }
+
+    ShmBusWriter(ShmBusWriter &&) = delete;
+    ShmBusWriter(const ShmBusWriter &) = delete;
+    ShmBusWriter &operator=(ShmBusWriter &&) = delete;
+    ShmBusWriter &operator=(const ShmBusWriter &) = delete;
+
+    ForceInline uint64_t seq() const { return seq_; }
+
+    HintHot void publishTrade(const Trade &trade) {
+        BusRecord &record = begin();
+        record.type_ = BusRecordType::Trade;
+        record.trade_ = trade;
+        commit(record);
+        snapshotIfDue();
+    }
+
+    HintHot void publishDelta(const DeltaT &delta) {
+        for (uint16_t i = 0; i < delta.updateSize_; i++) {
+            const PriceLevelUpdate &update = delta.updates_[i];
+            BusRecord &record = begin();
+            record.type_ = BusRecordType::Level;
+            BusLevel &levelRef = record.level_;
+            levelRef.side_ = update.side_;
+            levelRef.rank_ = update.rank_;
+            levelRef.last_ = (i + 1 == delta.updateSize_);
+            levelRef.bidSize_ = delta.bidSize_;
+            levelRef.askSize_ = delta.askSize_;
+            levelRef.level_ = update.level_;
+            commit(record);
+        }
+        delta.applyTo(book_);
+        snapshotIfDue();
+    }
+
+    // trades pending in the broker sink then the book delta since the previous call
+    template <class BrokerImplT>
+    void publishFrom(BrokerImplT &broker) {
+        static_assert(BrokerImplT::skBookDepth == N, "book depth of the broker and the bus differ");
+        broker.sink().drain([&](const BrokerEvent &event) {
+            if (event.type_ == EventType::Trade) {
+                publishTrade(event.trade_);
+            }
+        });
+        broker.getOrderBookDelta(delta_);
+        if (delta_.updateSize_) {
+            publishDelta(delta_);
+        }
+    }
+
+   private:
+    // only called between deltas so the snapshot is a consistent book
+    ForceInline void snapshotIfDue() {
+        if (seq_ - snapshotSeq_ >= snapshotInterval_) [[unlikely]] {
+            snapshot();
+        }
+    }
+
+    HintCold NoInline void snapshot() {
+        snapshotSeq_ = seq_;
+        header_->snapshot_.publish([&](BusSnapshot<N> &snapshotRef) {
+            snapshotRef.seq_ = seq_;
+            std::memcpy(&snapshotRef.book_, &book_, sizeof(book_));
+        });
+    }
+
+    ForceInline BusRecord &begin() {
+        BusRecord &record = records_[++seq_ & mask_];
+        record.seq_.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        return record;
+    }
+
+    ForceInline void commit(BusRecord &record) {
+        record.seq_.store(seq_, std::memory_order_release);
+        header_->writeSeq_.store(seq_, std::memory_order_release);
+    }
+
+   private:
+    const std::string name_;
+    const uint64_t mask_;
+    const uint64_t snapshotInterval_;
+    size_t size_ = 0;
+    HeaderT *header_ = nullptr;
+    BusRecord *records_ = nullptr;
+
+    uint64_t seq_ = 0;
+    uint64_t snapshotSeq_ = 0;
+    Orderbook<N> book_;
+    DeltaT delta_;
+};
+
+template <size_t N>
+struct ShmBusReader {
+    using HeaderT = BusHeader<N>;
+
+    explicit ShmBusReader(const std::string &name) {
+        const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            throw std::runtime_error("shm_open failed for " + name);
+        }
+        struct stat st;
+        void *base = fstat(fd, &st) ? MAP_FAILED : mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED) {
+            throw std::runtime_error("failed to map " + name);
+        }
+        size_ = st.st_size;
+        header_ = static_cast<const HeaderT *>(base);
+        records_ = reinterpret_cast<const BusRecord *>(static_cast<const char *>(base) + sizeof(HeaderT));
+
+        if (size_ < sizeof(HeaderT) || header_->magic_ != HeaderT::skMagic ||
+            header_->layoutVersion_ != HeaderT::skLayoutVersion || header_->depth_ != N ||
+            size_ < sizeof(HeaderT) + header_->capacity_ * sizeof(BusRecord)) {
+            munmap(base, size_);
+            throw std::runtime_error("unexpected layout of " + name);
+        }
+        mask_ = header_->capacity_ - 1;
+        resync();
+    }
+
+    ~ShmBusReader() { munmap(const_cast<HeaderT *>(header_), size_); }
+
+    ShmBusReader(ShmBusReader &&) = delete;
+    ShmBusReader(const ShmBusReader &) = delete;
+    ShmBusReader &operator=(ShmBusReader &&) = delete;
+    ShmBusReader &operator=(const ShmBusReader &) = delete;
+
+    // book as of the last complete delta
+    ForceInline const Orderbook<N> &book() const { return book_; }
+    // sequence number of the next record to read
+    ForceInline uint64_t nextSeq() const { return nextSeq_; }
+    ForceInline uint64_t overruns() const { return overruns_; }
+    ForceInline uint64_t lag() const { return header_->writeSeq_.load(std::memory_order_acquire) + 1 - nextSeq_; }
+
+    // read up to maxCount records, handler.onTrade(const Trade &) for trades and
+    // handler.onBook(const Orderbook<N> &) after each complete delta and after a resync
+    template <class H>
+    HintHot size_t poll(H &handler, size_t maxCount) {
+        size_t count = 0;
+        while (count < maxCount) {
+            const BusRecord &record = records_[nextSeq_ & mask_];
+            const uint64_t constSeq = record.seq_.load(std::memory_order_acquire);
+            if (constSeq != nextSeq_) {
+                // older or being written means caught up, newer means overwritten
+                if (constSeq > nextSeq_) [[unlikely]] {
+                    overrun(handler);
+                    continue;
+                }
+                break;
+            }
+
+            const BusRecordType constType = record.type_;
+            BusLevel level;
+            Trade trade;
+            if (constType == BusRecordType::Trade) {
+                trade = record.trade_;
+            } else {
+                level = record.level_;
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (record.seq_.load(std::memory_order_relaxed) != constSeq) [[unlikely]] {
+                overrun(handler);
+                continue;
+            }
+
+            ++nextSeq_;
+            ++count;
+            if (constType == BusRecordType::Trade) {
+                handler.onTrade(trade);
+            } else if (constType == BusRecordType::Level) {
+                PriceLevel &levelRef = (level.side_ == QuoteType::Buy) ? book_.bid(level.rank_) : book_.ask(level.rank_);
+                levelRef = level.level_;
+                if (level.last_) {
+                    book_.bidSize_ = level.bidSize_;
+                    book_.askSize_ = level.askSize_;
+                    handler.onBook(book_);
+                }
+            }
+        }
+        return count;
+    }
+
+   private:
+    template <class H>
+    HintCold NoInline void overrun(H &handler) {
+        ++overruns_;
+        resync();
+        handler.onBook(book_);
+    }
+
+    // restart from the latest snapshot, or from the first record when none was taken yet
+    void resync() {
+        BusSnapshot<N> snapshot;
+        if (header_->snapshot_.read(snapshot)) {
+            book_ = snapshot.book_;
+            nextSeq_ = snapshot.seq_ + 1;
+        } else {
+            book_ = Orderbook<N>();
+            nextSeq_ = 1;
+        }
+    }
+
+   private:
+    size_t size_ = 0;
+    const HeaderT *header_ = nullptr;
+    const BusRecord *records_ = nullptr;
+    uint64_t mask_ = 0;
+
+    uint64_t nextSeq_ = 1;
+    uint64_t overruns_ = 0;
+    Orderbook<N> book_;
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include "brokerArena.h"
+#include "flatPool.h"
+#include "util.h"
+
+// values indexed by the handles of a FlatPool, e.g. the cold fields of its entries which would only
+// dilute the cache lines of the hot ones. chunked like the pool so it grows along with it, chunks are
+// taken from the arena and value initialized when a handle reaches them first.
+template <class T>
+struct SideTable final {
+    using DataT = T;
+    using SelfT = SideTable<DataT>;
+
+    static constexpr int32_t skChunkCapacity = 8192;
+    static constexpr int32_t skChunkCapacityExponent = 13;  // 2^13 = 8192
+    static constexpr int32_t skChunkCapacityMask = skChunkCapacity - 1;
+    static constexpr int32_t skMaxChunkSize = 4096;
+
+    explicit SideTable(BrokerArena &arena) : arena_(arena) {
+        static_assert(std::is_trivially_destructible_v<DataT>, "arena chunks are never destroyed");
+    }
+
+    SideTable(SideTable &&) = delete;
+    SideTable(const SideTable &) = delete;
+    SideTable &operator=(SideTable &&) = delete;
+    SideTable &operator=(const SideTable &) = delete;
+
+    ForceInline DataT &operator[](PoolHandle handle) {
+        const int32_t constChunk = handle >> SelfT::skChunkCapacityExponent;
+        if (constChunk >= chunkCount_) [[unlikely]] {
+            grow(constChunk);
+        }
+        return chunks_[constChunk][handle & SelfT::skChunkCapacityMask];
+    }
+
+    // handle must have been reached by operator[] before
+    ForceInline const DataT &at(PoolHandle handle) const {
+        return chunks_[handle >> SelfT::skChunkCapacityExponent][handle & SelfT::skChunkCapacityMask];
+    }
+
+    ForceInline size_t chunkCount() const { return chunkCount_; }
+
+    // forget every chunk in O(1), they go back with the arena, see BrokerArena::reset
+    void reset() { chunkCount_ = 0; }
+
+   private:
+    HintCold NoInline void grow(int32_t chunk) {
+        if (chunk >= SelfT::skMaxChunkSize) {
+            throw std::out_of_range("SideTable chunk limit reached");
+        }
+        while (chunkCount_ <= chunk) {
+            DataT *values = static_cast<DataT *>(
+                arena_.allocate(sizeof(DataT) * SelfT::skChunkCapacity, kDefaultCacheLineSize));
+            std::uninitialized_value_construct_n(values, SelfT::skChunkCapacity);
+            chunks_[chunkCount_++] = values;
+        }
+    }
+
+   private:
+    int32_t chunkCount_ = 0;
+    BrokerArena &arena_;
+    DataT *chunks_[SelfT::skMaxChunkSize] = {};
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "util.h"
+
+// single producer single consumer ring of T, lock free.
+// the producer and consumer indexes live on their own cache lines, each side also keeps a cached
+// copy of the other's index so the shared line is only read when the cached view says full/empty.
+// batched calls publish their index once for the whole batch.
+template <class T, uint32_t kCapacity>
+struct SpscRing {
+    static_assert((kCapacity & (kCapacity - 1)) == 0, "kCapacity must be power of 2");
+    static constexpr uint64_t skMask = kCapacity - 1;
+
+    SpscRing() = default;
+    SpscRing(SpscRing &&) = delete;
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(SpscRing &&) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    static constexpr uint32_t capacity() { return kCapacity; }
+
+    // consumer side view, exact only when the producer is idle
+    ForceInline size_t size() const {
+        return head_.value_.load(std::memory_order_acquire) - tail_.value_.load(std::memory_order_relaxed);
+    }
+    ForceInline bool empty() const { return !size(); }
+
+    // producer
+    ForceInline bool tryPush(const T &value) { return push(&value, 1); }
+
+    // producer, push up to count values, return the number pushed
+    HintHot size_t push(const T *values, size_t count) {
+        const uint64_t constHead = head_.value_.load(std::memory_order_relaxed);
+        if (constHead + count - head_.cachedOther_ > kCapacity) [[unlikely]] {
+            head_.cachedOther_ = tail_.value_.load(std::memory_order_acquire);
+            const uint64_t constFree = kCapacity - (constHead - head_.cachedOther_);
+            count = (count < constFree) ? count : constFree;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            slots_[(constHead + i) & skMask] = values[i];
+        }
+        head_.value_.store(constHead + count, std::memory_order_release);
+        return count;
+    }
+
+    // consumer
+    ForceInline bool tryPop(T &value) {
+        return consume([&](const T &slot) { value = slot; }, 1);
+    }
+
+    // consumer, visit up to maxCount values in place with fn(const T &), return the number consumed
+    template <class F>
+    HintHot size_t consume(F &&fn, size_t maxCount) {
+        const uint64_t constTail = tail_.value_.load(std::memory_order_relaxed);
+        if (tail_.cachedOther_ - constTail < maxCount) {
+            tail_.cachedOther_ = head_.value_.load(std::memory_order_acquire);
+        }
+        const uint64_t constReady = tail_.cachedOther_ - constTail;
+        const size_t constCount = (constReady < maxCount) ? constReady : maxCount;
+        for (size_t i = 0; i < constCount; i++) {
+            fn(slots_[(constTail + i) & skMask]);
+        }
+        if (constCount) {
+            tail_.value_.store(constTail + constCount, std::memory_order_release);
+        }
+        return constCount;
+    }
+
+   private:
+    // own index and cached index of the other side, written by one side only
+    struct alignas(kDefaultCacheLineSize) Index {
+        std::atomic<uint64_t> value_{0};
+        uint64_t cachedOther_ = 0;
+    };
+
+    Index head_;
+    Index tail_;
+    alignas(kDefaultCacheLineSize) T slots_[kCapacity];
+};
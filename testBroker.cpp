@@ -1,47 +1,92 @@
+#include <sys/resource.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <set>
+#include <sstream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
 #include <vector>
 #include "broker.h"
+#include "brokerMetrics.h"
+#include "brokerRegistry.h"
+#include "btreeBook.h"
+#include "hotOrder.h"
+#include "ladderBook.h"
+#include "latencyHistogram.h"
 #include "orderBookInlinePrint.h"
+#include "orderCsvParser.h"
+#include "orderFlow.h"
+#include "perfCounters.h"
+#include "pipeline.h"
+#include "preTradeRisk.h"
+#include "replayFile.h"
+#include "seqlockBook.h"
+#include "shmBus.h"
+#include "tickScale.h"
 
-void usage() { std::cout << "usage: ./tob number_of_orders" << std::endl; }
-
-int32_t main(int32_t argc, char* argv[]) {
-    if (argc != 2) {
-        usage();
-        return -1;
-    }
+void usage() {
+    std::cout << "usage: ./tob number_of_orders" << std::endl
+              << "       ./tob convert orders.csv orders.tobr [scale tick_size]" << std::endl
+              << "       ./tob replay orders.tobr [recorded]" << std::endl
+              << "       ./tob csvbench orders.csv [size_mb]" << std::endl
+              << "       ./tob latency number_of_orders cancel_ratio market_ratio aggressive_ratio depth_ticks"
+              << std::endl
+              << "       ./tob perf number_of_orders" << std::endl
+              << "       ./tob metrics number_of_orders" << std::endl
+              << "       ./tob warmup number_of_orders" << std::endl
+              << "       ./tob reset number_of_orders" << std::endl
+              << "       ./tob hot number_of_orders" << std::endl
+              << "       ./tob risk number_of_orders" << std::endl
+              << "       ./tob protect number_of_orders" << std::endl
+              << "       ./tob check" << std::endl;
+}
 
+template <class BrokerImplT>
+void benchBroker(const char* name, int32_t constV, const TickScale& tickScale) {
+    std::cout << "===============" << name << "===============" << std::endl;
     TscClock& clock = TscClock::getInstance();
-    clock.calibrate();
-    std::cout << clock << std::endl;
-
-    Broker broker;
+    auto broker = std::make_unique<BrokerImplT>(constV * 2);
     Orderbook<10> zob;
     uint64_t beginTick = 0, endTick = 0, totalTick = 0;
-    const int32_t constV = std::stoull(argv[1]);
     const float constFv = static_cast<float>(constV);
+    // coids run up, a coid still resting would be rejected as a duplicate instead of inserted
+    uint64_t nextCoid = 1;
 
     {
         for (auto i = 0; i < constV; i++) {
             Order o;
             const int32_t v = i & 1;
             o.type_ = OrderType::Limit;
-            o.coid_ = o.createTimeNs_ = clock.rdNs();
+            o.coid_ = nextCoid++;
+            o.createTimeNs_ = clock.rdNs();
 
             if (0 == v) {
-                o.price_ = (constV - i) % 100 + 1;
+                o.price_ = tickScale.toTicks((constV - i) % 100 + 1);
                 o.remainQty_ = o.qty_ = i % 10 + 1;
                 o.side_ = QuoteType::Buy;
             } else {
-                o.price_ = (constV + i) % 100 + 100;
+                o.price_ = tickScale.toTicks((constV + i) % 100 + 100);
                 o.remainQty_ = o.qty_ = i % 10 + 1;
                 o.side_ = QuoteType::Sell;
             }
             beginTick = clock.rdTsc();
-            broker.insertOrder(o);
-            // broker.getOrderBook(zob);
+            broker->insertOrder(o);
+            // broker->getOrderBook(zob);
             // showOrderBook(zob);
             endTick = clock.rdTsc();
             totalTick += endTick - beginTick;
@@ -50,9 +95,9 @@ int32_t main(int32_t argc, char* argv[]) {
         std::cout << "build orderbook in :" << clock.tsc2Ns(totalTick) / constFv << "ns" << std::endl;
 
         beginTick = clock.rdTsc();
-        broker.getOrderBook(zob);
+        broker->getOrderBook(zob);
         endTick = clock.rdTsc();
-        showOrderBook(zob);
+        showOrderBook(zob, tickScale);
         std::cout << "latency of getOrderBook is: " << clock.tsc2Ns(endTick - beginTick) << "ns" << std::endl;
         std::cout << std::endl << std::endl;
     }
@@ -63,27 +108,28 @@ int32_t main(int32_t argc, char* argv[]) {
             Order o;
             const int32_t v = i & 1;
             o.type_ = OrderType::Limit;
-            o.coid_ = o.createTimeNs_ = clock.rdNs();
+            o.coid_ = nextCoid++;
+            o.createTimeNs_ = clock.rdNs();
             if (0 == v) {
-                o.price_ = (constV + i) % 100 + 100;
+                o.price_ = tickScale.toTicks((constV + i) % 100 + 100);
                 o.remainQty_ = o.qty_ = i % 10 + 1;
                 o.side_ = QuoteType::Buy;
             } else {
-                o.price_ = (constV - i) % 100 + 1;
+                o.price_ = tickScale.toTicks((constV - i) % 100 + 1);
                 o.remainQty_ = o.qty_ = i % 10 + 1;
                 o.side_ = QuoteType::Sell;
             }
             // std::cout << "insert order: " << o << std::endl;
             beginTick = clock.rdTsc();
-            broker.insertOrder(o);
+            broker->insertOrder(o);
             // Preventing Optimization
-            // broker.getOrderBook(zob);
+            // broker->getOrderBook(zob);
             endTick = clock.rdTsc();
             totalTick += endTick - beginTick;
 
             /*{
                 beginTick = clock.rdTsc();
-                broker.getOrderBook(zob);
+                broker->getOrderBook(zob);
                 endTick = clock.rdTsc();
                 showOrderBook(zob);
                 std::cout << "delay for getOrderBook<10>: " << clock.tsc2Ns(endTick - beginTick) << "ns" <<
@@ -94,13 +140,1968 @@ int32_t main(int32_t argc, char* argv[]) {
         std::cout << "each order is matched in :" << clock.tsc2Ns(totalTick) / constFv << "ns" << std::endl;
 
         beginTick = clock.rdTsc();
-        broker.getOrderBook(zob);
+        broker->getOrderBook(zob);
         endTick = clock.rdTsc();
-        showOrderBook(zob);
+        showOrderBook(zob, tickScale);
         std::cout << "latency of getOrderBook is: " << clock.tsc2Ns(endTick - beginTick) << "ns" << std::endl;
         std::cout << std::endl << std::endl;
     }
 
+    {
+        // deep book: passive inserts at random prices over 3000 ticks on each side, and cancels of random resting orders
+        std::mt19937 rng(constV);
+        std::vector<Order> restingOrders;
+        restingOrders.reserve(constV);
+        const Price constMid = tickScale.toTicks(150);
+        totalTick = 0;
+        uint64_t snapshotTick = 0, deltaTick = 0;
+        OrderbookDelta<10> delta;
+        for (auto i = 0; i < constV; i++) {
+            Order o;
+            if ((rng() & 1) && !restingOrders.empty()) {
+                const size_t index = rng() % restingOrders.size();
+                o = restingOrders[index];
+                restingOrders[index] = restingOrders.back();
+                restingOrders.pop_back();
+                o.orderStatus_ = OrderStatus::Canceled;
+            } else {
+                o.type_ = OrderType::Limit;
+                o.coid_ = nextCoid++;
+                o.createTimeNs_ = clock.rdNs();
+                o.side_ = (rng() & 1) ? QuoteType::Buy : QuoteType::Sell;
+                const Price offset = rng() % 3000 + 1;
+                o.price_ = (o.side_ == QuoteType::Buy) ? constMid - offset : constMid + offset;
+                o.remainQty_ = o.qty_ = i % 10 + 1;
+                o.orderStatus_ = OrderStatus::New;
+                restingOrders.push_back(o);
+            }
+
+            beginTick = clock.rdTsc();
+            if (o.orderStatus_ == OrderStatus::Canceled) {
+                broker->cancelOrder(o);
+            } else {
+                broker->insertOrder(o);
+            }
+            endTick = clock.rdTsc();
+            totalTick += endTick - beginTick;
+
+            // publish after every message, as a full snapshot and as the changed levels only
+            beginTick = clock.rdTsc();
+            broker->getOrderBook(zob);
+            endTick = clock.rdTsc();
+            snapshotTick += endTick - beginTick;
+
+            beginTick = clock.rdTsc();
+            broker->getOrderBookDelta(delta);
+            endTick = clock.rdTsc();
+            deltaTick += endTick - beginTick;
+        }
+
+        std::cout << "each insert/cancel on deep book in :" << clock.tsc2Ns(totalTick) / constFv << "ns" << std::endl;
+        std::cout << "each getOrderBook<10> after it in :" << clock.tsc2Ns(snapshotTick) / constFv << "ns" << std::endl;
+        std::cout << "each getOrderBookDelta after it in :" << clock.tsc2Ns(deltaTick) / constFv << "ns" << std::endl;
+
+        // FOK orders through the whole opposite side, killed by the depth index without touching the book
+        totalTick = 0;
+        for (auto i = 0; i < constV; i++) {
+            Order o;
+            o.type_ = OrderType::Limit;
+            o.tif_ = TimeInForce::FOK;
+            o.coid_ = nextCoid++;
+            o.createTimeNs_ = clock.rdNs();
+            o.side_ = (i & 1) ? QuoteType::Buy : QuoteType::Sell;
+            o.price_ = (o.side_ == QuoteType::Buy) ? constMid + 3000 : constMid - 3000;
+            o.remainQty_ = o.qty_ = std::numeric_limits<Qty>::max();
+
+            beginTick = clock.rdTsc();
+            broker->insertOrder(o);
+            endTick = clock.rdTsc();
+            totalTick += endTick - beginTick;
+        }
+        std::cout << "each FOK reject on deep book in :" << clock.tsc2Ns(totalTick) / constFv << "ns" << std::endl;
+        std::cout << std::endl << std::endl;
+    }
+}
+
+// the same bursts of inserts around the touch and cancels of random resting orders, published once per burst,
+// fed one order at a time then through insertOrders/cancelOrders
+template <class BrokerImplT>
+void benchBatch(const char* name, int32_t constV, const TickScale& tickScale) {
+    constexpr size_t constBurst = 32;
+    std::cout << "===============" << name << " bursts of " << constBurst << "===============" << std::endl;
+    TscClock& clock = TscClock::getInstance();
+
+    std::mt19937 rng(constV);
+    std::vector<Order> orders(constV);
+    std::vector<uint64_t> coids;
+    coids.reserve(constV);
+    const Price constMid = tickScale.toTicks(150);
+    for (size_t i = 0; i < orders.size(); i++) {
+        Order& o = orders[i];
+        o.coid_ = o.createTimeNs_ = i + 1;
+        o.side_ = (rng() & 1) ? QuoteType::Buy : QuoteType::Sell;
+        // a few ticks through the touch so that some orders match
+        const Price offset = static_cast<Price>(rng() % 200) - 5;
+        o.price_ = (o.side_ == QuoteType::Buy) ? constMid - offset : constMid + offset;
+        o.remainQty_ = o.qty_ = i % 10 + 1;
+        o.type_ = OrderType::Limit;
+        o.orderStatus_ = OrderStatus::New;
+        coids.push_back(rng() % (i + 1) + 1);
+    }
+
+    const float constFv = static_cast<float>(orders.size() + coids.size());
+    OrderbookDelta<10> delta;
+    {
+        auto broker = std::make_unique<BrokerImplT>(constV * 2);
+        uint64_t beginTick = clock.rdTsc();
+        for (size_t i = 0; i < orders.size(); i += constBurst) {
+            const size_t constEnd = std::min(i + constBurst, orders.size());
+            for (size_t j = i; j < constEnd; j++) {
+                broker->insertOrder(orders[j]);
+            }
+            broker->getOrderBookDelta(delta);
+            for (size_t j = i; j < constEnd; j++) {
+                broker->cancelOrder(coids[j]);
+            }
+            broker->getOrderBookDelta(delta);
+        }
+        uint64_t endTick = clock.rdTsc();
+        std::cout << "each order one by one in :" << clock.tsc2Ns(endTick - beginTick) / constFv << "ns" << std::endl;
+    }
+
+    {
+        auto broker = std::make_unique<BrokerImplT>(constV * 2);
+        const std::span<const Order> constOrders(orders);
+        const std::span<const uint64_t> constCoids(coids);
+        uint64_t beginTick = clock.rdTsc();
+        for (size_t i = 0; i < orders.size(); i += constBurst) {
+            const size_t constCount = std::min(constBurst, orders.size() - i);
+            broker->insertOrders(constOrders.subspan(i, constCount));
+            broker->getOrderBookDelta(delta);
+            broker->cancelOrders(constCoids.subspan(i, constCount));
+            broker->getOrderBookDelta(delta);
+        }
+        uint64_t endTick = clock.rdTsc();
+        std::cout << "each order in batch in :" << clock.tsc2Ns(endTick - beginTick) / constFv << "ns" << std::endl;
+    }
+    std::cout << std::endl << std::endl;
+}
+
+// orders spread over symbols fed by one producer to 1, 2, 4... shards pinned to cores 1, 2, 3...,
+// throughput of submitting and draining all of them
+template <class BrokerImplT>
+void benchRegistry(const char* name, int32_t constV, const TickScale& tickScale) {
+    constexpr uint32_t constSymbols = 256;
+    std::cout << "===============" << name << " " << constSymbols << " symbols===============" << std::endl;
+    TscClock& clock = TscClock::getInstance();
+
+    std::mt19937 rng(constV);
+    std::vector<Order> orders(constV);
+    std::vector<Price> mids(constSymbols);
+    for (auto& mid : mids) {
+        mid = tickScale.toTicks(rng() % 100 + 100);
+    }
+    for (size_t i = 0; i < orders.size(); i++) {
+        Order& o = orders[i];
+        if ((rng() % 3 == 0) && i) {
+            // cancel of an earlier order, which may be filled already
+            o = orders[rng() % i];
+            o.orderStatus_ = OrderStatus::Canceled;
+            continue;
+        }
+        o.sid_ = rng() % constSymbols;
+        o.coid_ = o.createTimeNs_ = i + 1;
+        o.side_ = (rng() & 1) ? QuoteType::Buy : QuoteType::Sell;
+        const Price offset = static_cast<Price>(rng() % 200) - 5;
+        o.price_ = (o.side_ == QuoteType::Buy) ? mids[o.sid_] - offset : mids[o.sid_] + offset;
+        o.remainQty_ = o.qty_ = i % 10 + 1;
+        o.type_ = OrderType::Limit;
+        o.orderStatus_ = OrderStatus::New;
+    }
+
+    const uint32_t constCores = std::max(1u, std::thread::hardware_concurrency());
+    const uint32_t constMaxOrders = constV / constSymbols * 2 + 1024;
+    // the producer is pinned for the run only, the benchmarks after this one run where they did before
+    const cpu_set_t constAffinity = currentAffinity();
+    for (uint32_t shards = 1; shards <= std::max(1u, constCores - 1); shards *= 2) {
+        // core 0 is left to the producer
+        std::vector<int32_t> cores;
+        for (uint32_t i = 0; i < shards; i++) {
+            cores.push_back(constCores > 1 ? static_cast<int32_t>(i + 1) : -1);
+        }
+        auto registry = std::make_unique<BrokerRegistry<BrokerImplT>>(constSymbols, cores, constMaxOrders);
+        pinCurrentThread(0);
+
+        const uint64_t beginTick = clock.rdTsc();
+        for (const Order& o : orders) {
+            registry->submit(o);
+        }
+        registry->drain();
+        const uint64_t endTick = clock.rdTsc();
+        std::cout << shards << " shards: " << orders.size() * 1e3 / clock.tsc2Ns(endTick - beginTick)
+                  << " M orders/s" << std::endl;
+    }
+    setCurrentAffinity(constAffinity);
+    std::cout << std::endl << std::endl;
+}
+
+// insert/cancel on the writer thread publishing the book after every message, with no reader then with
+// readers spinning on other cores, publish latency of the writer and reads per second of the readers
+template <class BrokerImplT>
+void benchSeqlock(const char* name, int32_t constV, const TickScale& tickScale) {
+    std::cout << "===============" << name << " seqlock book===============" << std::endl;
+    TscClock& clock = TscClock::getInstance();
+
+    std::mt19937 rng(constV);
+    std::vector<Order> orders(constV);
+    const Price constMid = tickScale.toTicks(150);
+    for (size_t i = 0; i < orders.size(); i++) {
+        Order& o = orders[i];
+        if ((rng() & 1) && i) {
+            o = orders[rng() % i];
+            o.orderStatus_ = OrderStatus::Canceled;
+            continue;
+        }
+        o.coid_ = o.createTimeNs_ = i + 1;
+        o.side_ = (rng() & 1) ? QuoteType::Buy : QuoteType::Sell;
+        const Price offset = static_cast<Price>(rng() % 50) + 1;
+        o.price_ = (o.side_ == QuoteType::Buy) ? constMid - offset : constMid + offset;
+        o.remainQty_ = o.qty_ = i % 10 + 1;
+        o.type_ = OrderType::Limit;
+        o.orderStatus_ = OrderStatus::New;
+    }
+
+    const uint32_t constCores = std::thread::hardware_concurrency();
+    const uint32_t constMaxReaders = std::clamp(constCores, 2u, 4u) - 1;
+    for (uint32_t readerCount : {0u, constMaxReaders}) {
+        auto broker = std::make_unique<BrokerImplT>(constV * 2);
+        auto book = std::make_unique<SeqlockBook<10>>();
+        std::atomic<bool> running{true};
+        std::vector<uint64_t> reads(readerCount * 8);
+        std::vector<std::thread> readers;
+        for (uint32_t r = 0; r < readerCount; r++) {
+            readers.emplace_back([&, r] {
+                pinCurrentThread(constCores > readerCount ? static_cast<int32_t>(r + 1) : -1);
+                Orderbook<10> ob;
+                uint64_t count = 0;
+                while (running.load(std::memory_order_relaxed)) {
+                    book->read(ob);
+                    ++count;
+                }
+                // one cache line apart
+                reads[r * 8] = count;
+            });
+        }
+
+        uint64_t publishTick = 0, publishCount = 0;
+        const uint64_t beginTick = clock.rdTsc();
+        for (const Order& o : orders) {
+            if (o.orderStatus_ == OrderStatus::Canceled) {
+                broker->cancelOrder(o);
+            } else {
+                broker->insertOrder(o);
+            }
+            const uint64_t constPublishBegin = clock.rdTsc();
+            publishCount += broker->publishOrderBook(*book);
+            publishTick += clock.rdTsc() - constPublishBegin;
+        }
+        const uint64_t endTick = clock.rdTsc();
+        running.store(false);
+        for (auto& reader : readers) {
+            reader.join();
+        }
+
+        uint64_t totalReads = 0;
+        for (uint32_t r = 0; r < readerCount; r++) {
+            totalReads += reads[r * 8];
+        }
+        std::cout << readerCount << " readers: each publishOrderBook in :" << clock.tsc2Ns(publishTick) / orders.size()
+                  << "ns, " << publishCount << " books published, "
+                  << totalReads * 1e3 / clock.tsc2Ns(endTick - beginTick) << " M reads/s" << std::endl;
+    }
+    std::cout << std::endl << std::endl;
+}
+
+// counts what reaches the publish stage
+struct CountingPublisher {
+    uint64_t events_ = 0;
+    uint64_t deltas_ = 0;
+
+    void onEvent(const BrokerEvent&) { ++events_; }
+    template <size_t N>
+    void onBookDelta(const OrderbookDelta<N>&) {
+        ++deltas_;
+    }
+};
+
+// orders around the touch through decode, risk, match and publish stages pinned to cores 1 to 4,
+// latency of each stage including queueing for several batch sizes
+template <class BrokerImplT>
+void benchPipeline(const char* name, int32_t constV, const TickScale& tickScale) {
+    std::cout << "===============" << name << " pipeline===============" << std::endl;
+    TscClock& clock = TscClock::getInstance();
+
+    std::mt19937 rng(constV);
+    std::vector<InsertOrder> messages(constV);
+    const Price constMid = tickScale.toTicks(150);
+    for (size_t i = 0; i < messages.size(); i++) {
+        InsertOrder& m = messages[i];
+        m.coid_ = i + 1;
+        m.side_ = (rng() & 1) ? QuoteType::Buy : QuoteType::Sell;
+        const Price offset = static_cast<Price>(rng() % 200) - 5;
+        m.price_ = (m.side_ == QuoteType::Buy) ? constMid - offset : constMid + offset;
+        m.qty_ = i % 10 + 1;
+        m.type_ = OrderType::Limit;
+        m.tif_ = TimeInForce::GTC;
+    }
+
+    const bool constPinned = std::thread::hardware_concurrency() > 4;
+    for (uint32_t batchSize : {1u, 16u, 64u}) {
+        PipelineConfig config;
+        for (int32_t i = 0; i < 4; i++) {
+            config.cores_[i] = constPinned ? i + 1 : -1;
+        }
+        config.batchSize_ = batchSize;
+
+        using PipelineT = Pipeline<BrokerImplT, NoRisk, CountingPublisher>;
+        auto pipeline = std::make_unique<PipelineT>(config);
+        const uint64_t beginTick = clock.rdTsc();
+        for (const InsertOrder& m : messages) {
+            pipeline->submit(m);
+        }
+        pipeline->stop();
+        const uint64_t endTick = clock.rdTsc();
+
+        std::cout << "batch " << batchSize << ": " << messages.size() * 1e3 / clock.tsc2Ns(endTick - beginTick)
+                  << " M orders/s, " << pipeline->publisher().events_ << " events, " << pipeline->publisher().deltas_
+                  << " deltas" << std::endl;
+        const char* constStageNames[] = {"decode", "risk", "match", "publish"};
+        for (uint32_t stage = PipelineT::Decode; stage < PipelineT::StageCount; stage++) {
+            const StageStats& stats = pipeline->stats(static_cast<typename PipelineT::Stage>(stage));
+            std::cout << "  " << constStageNames[stage]
+                      << " avg: " << clock.tsc2Ns(stats.totalTicks_) / std::max<double>(1.0, stats.count_)
+                      << "ns, max: " << clock.tsc2Ns(stats.maxTicks_) << "ns" << std::endl;
+        }
+    }
+    std::cout << std::endl << std::endl;
+}
+
+// counts what a bus reader receives
+struct CountingBusHandler {
+    uint64_t trades_ = 0;
+    uint64_t books_ = 0;
+
+    void onTrade(const Trade&) { ++trades_; }
+    template <size_t N>
+    void onBook(const Orderbook<N>&) {
+        ++books_;
+    }
+};
+
+// trades and book deltas of crossing orders published to the shared memory bus after each order,
+// one reader thread maps the bus like another process would, a small ring makes it overrun and resync
+template <class BrokerImplT>
+void benchShmBus(const char* name, int32_t constV, const TickScale& tickScale) {
+    std::cout << "===============" << name << " shm bus===============" << std::endl;
+    TscClock& clock = TscClock::getInstance();
+
+    std::mt19937 rng(constV);
+    std::vector<Order> orders(constV);
+    const Price constMid = tickScale.toTicks(150);
+    for (size_t i = 0; i < orders.size(); i++) {
+        Order& o = orders[i];
+        o.coid_ = o.createTimeNs_ = i + 1;
+        o.side_ = (rng() & 1) ? QuoteType::Buy : QuoteType::Sell;
+        const Price offset = static_cast<Price>(rng() % 50) - 5;
+        o.price_ = (o.side_ == QuoteType::Buy) ? constMid - offset : constMid + offset;
+        o.remainQty_ = o.qty_ = i % 10 + 1;
+        o.type_ = OrderType::Limit;
+        o.orderStatus_ = OrderStatus::New;
+    }
+
+    const uint32_t constCores = std::thread::hardware_concurrency();
+    for (uint64_t capacity : {1ull << 16, 1ull << 8}) {
+        auto broker = std::make_unique<BrokerImplT>(constV * 2);
+        auto writer = std::make_unique<ShmBusWriter<BrokerImplT::skBookDepth>>("/tob_bench_bus", capacity, capacity / 4);
+        std::atomic<bool> running{true};
+        CountingBusHandler handler;
+        uint64_t overruns = 0, records = 0;
+        std::thread reader([&] {
+            pinCurrentThread(constCores > 1 ? 1 : -1);
+            ShmBusReader<BrokerImplT::skBookDepth> busReader("/tob_bench_bus");
+            while (running.load(std::memory_order_relaxed)) {
+                records += busReader.poll(handler, 256);
+            }
+            records += busReader.poll(handler, std::numeric_limits<size_t>::max());
+            overruns = busReader.overruns();
+        });
+
+        uint64_t publishTick = 0;
+        const uint64_t beginTick = clock.rdTsc();
+        for (const Order& o : orders) {
+            broker->insertOrder(o);
+            const uint64_t constPublishBegin = clock.rdTsc();
+            writer->publishFrom(*broker);
+            publishTick += clock.rdTsc() - constPublishBegin;
+        }
+        const uint64_t endTick = clock.rdTsc();
+        running.store(false);
+        reader.join();
+
+        std::cout << "capacity " << capacity << ": each publishFrom in :" << clock.tsc2Ns(publishTick) / orders.size()
+                  << "ns, " << writer->seq() << " records published, " << records << " read ("
+                  << handler.trades_ << " trades, " << handler.books_ << " books), " << overruns << " overruns, "
+                  << writer->seq() * 1e3 / clock.tsc2Ns(endTick - beginTick) << " M records/s" << std::endl;
+    }
+    std::cout << std::endl << std::endl;
+}
+
+// latency of each operation type under a generated order flow, the book is built up with
+// preload passive orders first. every backend replays the same events
+template <class BrokerImplT>
+void benchLatency(const char* name, const std::vector<FlowEvent>& events, uint32_t preload,
+                  const MarketProtection& protection = MarketProtection()) {
+    TscClock& clock = TscClock::getInstance();
+    enum Op : uint32_t { Passive = 0, Aggressive, Market, Cancel, GetOrderBook, OpCount };
+    const char* constOpNames[] = {"passive limit", "aggressive limit", "market", "cancel", "getOrderBook"};
+    static_assert(static_cast<uint32_t>(FlowOp::Count) == GetOrderBook, "one histogram per flow op");
+
+    auto broker = std::make_unique<BrokerImplT>(events.size() + 1);
+    broker->setMarketProtection(protection);
+    auto histograms = std::make_unique<LatencyHistogram<>[]>(OpCount);
+    Orderbook<10> ob;
+    for (size_t i = 0; i < events.size(); i++) {
+        const FlowEvent& event = events[i];
+        const uint64_t constBeginTick = clock.rdTsc();
+        if (event.op_ == FlowOp::Cancel) {
+            broker->cancelOrder(event.order_);
+        } else {
+            broker->insertOrder(event.order_);
+        }
+        const uint64_t constEndTick = clock.rdTsc();
+        if (i < preload) {
+            continue;
+        }
+        histograms[static_cast<uint32_t>(event.op_)].record(constEndTick - constBeginTick);
+
+        if (!(i & 7)) {
+            const uint64_t constBookTick = clock.rdTsc();
+            broker->getOrderBook(ob);
+            histograms[GetOrderBook].record(clock.rdTsc() - constBookTick);
+        }
+    }
+
+    std::cout << name << std::endl;
+    for (uint32_t op = Passive; op < OpCount; op++) {
+        const LatencyHistogram<>& histogram = histograms[op];
+        std::cout << "  " << std::left << std::setw(18) << constOpNames[op] << std::right << std::setw(9)
+                  << histogram.count() << std::setw(9) << clock.tsc2Ns(histogram.percentile(50)) << std::setw(9)
+                  << clock.tsc2Ns(histogram.percentile(99)) << std::setw(9) << clock.tsc2Ns(histogram.percentile(99.9))
+                  << std::setw(9) << clock.tsc2Ns(histogram.max()) << std::endl;
+    }
+}
+
+// p50/p99/p99.9/max per operation type of each backend and allocator under the same flow
+void benchLatencySuite(const char* name, const OrderFlowConfig& config, uint32_t preload, uint32_t count) {
+    std::cout << "===============" << name << " latency===============" << std::endl;
+    std::cout << "cancel " << config.cancelRatio_ << ", market " << config.marketRatio_ << ", aggressive "
+              << config.aggressiveRatio_ << ", depth " << config.depthTicks_ << " ticks, pareto alpha "
+              << config.paretoAlpha_ << ", " << preload << " preloaded orders" << std::endl;
+    OrderFlowGenerator generator(config);
+    std::vector<FlowEvent> events(preload + count);
+    for (size_t i = 0; i < events.size(); i++) {
+        generator.next(events[i], i < preload);
+    }
+
+    std::cout << "  " << std::left << std::setw(18) << "op(ns)" << std::right << std::setw(9) << "count"
+              << std::setw(9) << "p50" << std::setw(9) << "p99" << std::setw(9) << "p99.9" << std::setw(9) << "max"
+              << std::endl;
+    benchLatency<BrokerT<MapBook>>("std::map + arena", events, preload);
+    benchLatency<BrokerT<MapBookWith<zAllocator>>>("std::map + zAllocator", events, preload);
+    benchLatency<BrokerT<MapBookWith<std::allocator>>>("std::map + std::allocator", events, preload);
+    benchLatency<BrokerT<LadderBook<1 << 16>>>("price ladder", events, preload);
+    benchLatency<BrokerT<BTreeBook<>>>("b+tree", events, preload);
+    std::cout << std::endl << std::endl;
+}
+
+// market orders in a thin book with a heavy tail of sizes, unbounded and with protection bands:
+// a bounded market order stops at its band instead of sweeping the far levels
+void benchProtection(uint32_t count) {
+    OrderFlowConfig config;
+    config.meanOffsetTicks_ = 200.0;
+    config.depthTicks_ = 2000;
+    config.paretoAlpha_ = 1.1;
+    config.cancelRatio_ = 0.45;
+    config.marketRatio_ = 0.1;
+    const uint32_t constPreload = count / 50;
+    OrderFlowGenerator generator(config);
+    std::vector<FlowEvent> events(constPreload + count);
+    for (size_t i = 0; i < events.size(); i++) {
+        generator.next(events[i], i < constPreload);
+    }
+
+    std::cout << "===============thin book market protection latency===============" << std::endl;
+    std::cout << "  " << std::left << std::setw(18) << "op(ns)" << std::right << std::setw(9) << "count"
+              << std::setw(9) << "p50" << std::setw(9) << "p99" << std::setw(9) << "p99.9" << std::setw(9) << "max"
+              << std::endl;
+    using BrokerImplT = BrokerT<LadderBook<1 << 16>>;
+    benchLatency<BrokerImplT>("price ladder, unbounded", events, constPreload);
+    benchLatency<BrokerImplT>("price ladder, 100 bps band", events, constPreload, MarketProtection{100});
+    benchLatency<BrokerImplT>("price ladder, 10 bps band", events, constPreload, MarketProtection{10});
+    std::cout << std::endl << std::endl;
+}
+
+// ns per event of the same flow without and with metrics, the metrics are exported to shared memory
+// every skPublishInterval events and a monitor thread reads them like another process would
+template <class BrokerImplT>
+double runMetricsFlow(const std::vector<FlowEvent>& events, ShmMetricsWriter* writer) {
+    static constexpr size_t skPublishInterval = 1024;
+    TscClock& clock = TscClock::getInstance();
+    auto broker = std::make_unique<BrokerImplT>(events.size() + 1);
+    const uint64_t constBeginTick = clock.rdTsc();
+    for (size_t i = 0; i < events.size(); i++) {
+        const FlowEvent& event = events[i];
+        if (event.op_ == FlowOp::Cancel) {
+            broker->cancelOrder(event.order_);
+        } else {
+            broker->insertOrder(event.order_);
+        }
+        if (writer && !(i % skPublishInterval)) {
+            writer->publish(*broker);
+        }
+    }
+    if (writer) {
+        writer->publish(*broker);
+    }
+    return static_cast<double>(clock.tsc2Ns(clock.rdTsc() - constBeginTick)) / events.size();
+}
+
+void printMetrics(const BrokerMetricsSnapshot& snapshot) {
+    std::cout << "inserts " << snapshot.inserts_ << ", cancels " << snapshot.cancels_ << " (" << snapshot.cancelMisses_
+              << " not found), sweeps " << snapshot.sweeps_ << ", fills " << snapshot.fills_ << ", filled qty "
+              << snapshot.filledQty_ << std::endl;
+    std::cout << "levels swept per sweep p50/p99/max: " << snapshot.sweepLevels_.percentile(50) << "/"
+              << snapshot.sweepLevels_.percentile(99) << "/" << snapshot.sweepLevels_.max()
+              << ", fills per sweep p50/p99/max: " << snapshot.sweepFills_.percentile(50) << "/"
+              << snapshot.sweepFills_.percentile(99) << "/" << snapshot.sweepFills_.max() << std::endl;
+    std::cout << "levels " << snapshot.bidLevels_ << "/" << snapshot.askLevels_ << ", qty " << snapshot.bidQty_ << "/"
+              << snapshot.askQty_ << ", resting orders " << snapshot.restingOrders_ << std::endl;
+    for (const auto& [poolName, pool] : {std::pair{"level", snapshot.levelPool_}, std::pair{"order", snapshot.orderPool_}}) {
+        std::cout << poolName << " pool high water mark " << pool.highWaterMark_ << ", free list "
+                  << pool.freeListLength_ << ", chunks " << pool.chunkCount_ << std::endl;
+    }
+}
+
+void benchMetrics(uint32_t count) {
+    using PlainT = BrokerT<LadderBook<1 << 16>>;
+    using MeteredT = BrokerT<LadderBook<1 << 16>, NullSink, 10, BrokerMetrics>;
+    std::cout << "===============price ladder metrics===============" << std::endl;
+    const OrderFlowConfig constConfig;
+    OrderFlowGenerator generator(constConfig);
+    std::vector<FlowEvent> events(count);
+    for (size_t i = 0; i < events.size(); i++) {
+        generator.next(events[i], i < count / 4);
+    }
+
+    auto writer = std::make_unique<ShmMetricsWriter>("/tob_bench_metrics");
+    std::atomic<bool> running{true};
+    uint64_t reads = 0;
+    BrokerMetricsSnapshot snapshot;
+    std::thread monitor([&] {
+        const uint32_t constCores = std::thread::hardware_concurrency();
+        pinCurrentThread(constCores > 1 ? 1 : -1);
+        ShmMetricsReader reader("/tob_bench_metrics");
+        while (running.load(std::memory_order_relaxed)) {
+            reader.read(snapshot);
+            ++reads;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        reader.read(snapshot);
+    });
+
+    double plainNs = std::numeric_limits<double>::max(), meteredNs = plainNs;
+    for (int32_t rep = 0; rep < 3; rep++) {
+        plainNs = std::min(plainNs, runMetricsFlow<PlainT>(events, nullptr));
+        meteredNs = std::min(meteredNs, runMetricsFlow<MeteredT>(events, writer.get()));
+    }
+    running.store(false);
+    monitor.join();
+
+    std::cout << "each event without metrics in :" << plainNs << "ns, with metrics and export in :" << meteredNs
+              << "ns, " << reads << " snapshots read by the monitor" << std::endl;
+    printMetrics(snapshot);
+    std::cout << std::endl << std::endl;
+}
+
+// insert and cancel latency of a broker from its very first order, with the arena faulted on demand
+// and with the arena prefaulted, locked on huge pages and the pools reserved and warmed up front,
+// minor faults are those of the flow only
+template <class BrokerImplT>
+void runWarmupFlow(const char* name, const std::vector<FlowEvent>& events, bool reserve) {
+    TscClock& clock = TscClock::getInstance();
+    auto broker = std::make_unique<BrokerImplT>(events.size() + 1, reserve ? ArenaConfig() : BrokerArena::skOnDemand);
+    if (reserve) {
+        broker->reserve(events.size(), 1 << 16);
+        broker->warmup();
+    }
+
+    LatencyHistogram<> histogram;
+    rusage usageBegin, usageEnd;
+    getrusage(RUSAGE_THREAD, &usageBegin);
+    for (const FlowEvent& event : events) {
+        const uint64_t constBeginTick = clock.rdTsc();
+        if (event.op_ == FlowOp::Cancel) {
+            broker->cancelOrder(event.order_);
+        } else {
+            broker->insertOrder(event.order_);
+        }
+        histogram.record(clock.rdTsc() - constBeginTick);
+    }
+    getrusage(RUSAGE_THREAD, &usageEnd);
+
+    std::cout << "  " << std::left << std::setw(12) << name << std::right << std::setw(9)
+              << clock.tsc2Ns(histogram.percentile(50)) << std::setw(9) << clock.tsc2Ns(histogram.percentile(99))
+              << std::setw(9) << clock.tsc2Ns(histogram.percentile(99.9)) << std::setw(9)
+              << clock.tsc2Ns(histogram.percentile(99.99)) << std::setw(11) << clock.tsc2Ns(histogram.max())
+              << std::setw(11) << usageEnd.ru_minflt - usageBegin.ru_minflt << std::endl;
+}
+
+void benchWarmup(uint32_t count) {
+    OrderFlowConfig config;
+    config.cancelRatio_ = 0.1;
+    OrderFlowGenerator generator(config);
+    std::vector<FlowEvent> events(count);
+    for (FlowEvent& event : events) {
+        generator.next(event);
+    }
+
+    std::cout << "===============price ladder cold start===============" << std::endl;
+    std::cout << "  " << std::left << std::setw(12) << "pools(ns)" << std::right << std::setw(9) << "p50"
+              << std::setw(9) << "p99" << std::setw(9) << "p99.9" << std::setw(9) << "p99.99" << std::setw(11)
+              << "max" << std::setw(11) << "faults" << std::endl;
+    for (int32_t rep = 0; rep < 2; rep++) {
+        runWarmupFlow<BrokerT<LadderBook<1 << 16>>>("on demand", events, false);
+        runWarmupFlow<BrokerT<LadderBook<1 << 16>>>("reserved", events, true);
+    }
+    std::cout << std::endl << std::endl;
+}
+
+template <class BrokerImplT>
+void runResetFlow(BrokerImplT& broker, const std::vector<FlowEvent>& events, Orderbook<10>& ob,
+                  BrokerMetricsSnapshot& snapshot) {
+    for (const FlowEvent& event : events) {
+        if (event.op_ == FlowOp::Cancel) {
+            broker.cancelOrder(event.order_);
+        } else {
+            broker.insertOrder(event.order_);
+        }
+    }
+    broker.getOrderBook(ob);
+    broker.metrics(snapshot);
+}
+
+// time to clear a loaded broker with reset() and by destroying and constructing it again, the flow
+// replayed after reset() must end with the same book
+template <class BrokerImplT>
+void benchReset(const char* name, const std::vector<FlowEvent>& events) {
+    TscClock& clock = TscClock::getInstance();
+    auto broker = std::make_unique<BrokerImplT>(events.size() + 1);
+    Orderbook<10> firstOb, ob;
+    BrokerMetricsSnapshot firstSnapshot, snapshot;
+    runResetFlow(*broker, events, firstOb, firstSnapshot);
+
+    uint64_t beginTick = clock.rdTsc();
+    broker->reset();
+    const uint64_t constResetTicks = clock.rdTsc() - beginTick;
+    runResetFlow(*broker, events, ob, snapshot);
+    const bool constSame = !std::memcmp(&ob, &firstOb, sizeof(ob)) &&
+                           snapshot.restingOrders_ == firstSnapshot.restingOrders_ &&
+                           snapshot.bidQty_ == firstSnapshot.bidQty_ && snapshot.askQty_ == firstSnapshot.askQty_;
+
+    beginTick = clock.rdTsc();
+    broker.reset();
+    broker = std::make_unique<BrokerImplT>(events.size() + 1);
+    const uint64_t constRebuildTicks = clock.rdTsc() - beginTick;
+
+    std::cout << name << ": " << firstSnapshot.restingOrders_ << " resting orders, reset in :"
+              << clock.tsc2Ns(constResetTicks) / 1000 << "us, destroy and construct in :"
+              << clock.tsc2Ns(constRebuildTicks) / 1000 << "us, book after reset and replay "
+              << (constSame ? "same" : "DIFFERENT") << std::endl;
+}
+
+void benchResetSuite(uint32_t count) {
+    OrderFlowGenerator generator(OrderFlowConfig{});
+    std::vector<FlowEvent> events(count);
+    for (size_t i = 0; i < events.size(); i++) {
+        generator.next(events[i], i < count / 4);
+    }
+
+    std::cout << "===============reset===============" << std::endl;
+    benchReset<BrokerT<MapBook>>("std::map + arena", events);
+    benchReset<BrokerT<MapBookWith<zAllocator>>>("std::map + zAllocator", events);
+    benchReset<BrokerT<LadderBook<1 << 16>>>("price ladder", events);
+    benchReset<BrokerT<BTreeBook<>>>("b+tree", events);
+    std::cout << std::endl << std::endl;
+}
+
+// ns per event of the same flow fed as wire orders and as hot orders converted up front
+template <class BrokerImplT, class OrderT>
+double runHotFlow(const std::vector<FlowEvent>& events, const std::vector<OrderT>& orders) {
+    TscClock& clock = TscClock::getInstance();
+    auto broker = std::make_unique<BrokerImplT>(events.size() + 1);
+    const uint64_t constBeginTick = clock.rdTsc();
+    for (size_t i = 0; i < events.size(); i++) {
+        if (events[i].op_ == FlowOp::Cancel) {
+            broker->cancelOrder(orders[i].coid_);
+        } else {
+            broker->insertOrder(orders[i]);
+        }
+    }
+    return static_cast<double>(clock.tsc2Ns(clock.rdTsc() - constBeginTick)) / events.size();
+}
+
+void benchHotOrder(uint32_t count) {
+    using BrokerImplT = BrokerT<LadderBook<1 << 16>>;
+    OrderFlowGenerator generator(OrderFlowConfig{});
+    std::vector<FlowEvent> events(count);
+    std::vector<Order> orders(count);
+    std::vector<HotOrder> hotOrders(count);
+    for (size_t i = 0; i < events.size(); i++) {
+        generator.next(events[i], i < count / 4);
+        orders[i] = events[i].order_;
+        toHot(orders[i], hotOrders[i]);
+    }
+
+    std::cout << "===============price ladder hot orders===============" << std::endl;
+    std::cout << "Order " << sizeof(Order) << " bytes, HotOrder " << sizeof(HotOrder) << " bytes, ColdOrder "
+              << sizeof(ColdOrder) << " bytes, RestingOrder " << sizeof(RestingOrder) << " bytes" << std::endl;
+    double wireNs = std::numeric_limits<double>::max(), hotNs = wireNs;
+    for (int32_t rep = 0; rep < 3; rep++) {
+        wireNs = std::min(wireNs, runHotFlow<BrokerImplT>(events, orders));
+        hotNs = std::min(hotNs, runHotFlow<BrokerImplT>(events, hotOrders));
+    }
+    std::cout << "each event fed as Order in :" << wireNs << "ns, as HotOrder in :" << hotNs << "ns" << std::endl;
+    std::cout << std::endl << std::endl;
+}
+
+// ns per event of the same hot order flow through a broker with config as its risk limits
+template <class BrokerImplT>
+double runRiskFlow(const std::vector<FlowEvent>& events, const std::vector<HotOrder>& orders,
+                   const RiskConfig& config, uint64_t& rejects) {
+    TscClock& clock = TscClock::getInstance();
+    auto broker = std::make_unique<BrokerImplT>(events.size() + 1);
+    if constexpr (std::remove_reference_t<decltype(broker->risk())>::skEnabled) {
+        broker->risk().configure(config);
+    }
+    const uint64_t constBeginTick = clock.rdTsc();
+    for (size_t i = 0; i < events.size(); i++) {
+        if (events[i].op_ == FlowOp::Cancel) {
+            broker->cancelOrder(orders[i].coid_);
+        } else {
+            broker->insertOrder(orders[i]);
+        }
+    }
+    const uint64_t constTicks = clock.rdTsc() - constBeginTick;
+    rejects = 0;
+    if constexpr (std::remove_reference_t<decltype(broker->risk())>::skEnabled) {
+        for (uint32_t reason = 0; reason < PreTradeRisk::ReasonCount; reason++) {
+            rejects += broker->risk().rejects(static_cast<PreTradeRisk::Reason>(reason));
+        }
+    }
+    return static_cast<double>(clock.tsc2Ns(constTicks)) / events.size();
+}
+
+// cost of the inline pre-trade risk stage: limits nobody reaches, then limits rejecting part of the flow
+void benchRisk(uint32_t count) {
+    using BrokerImplT = BrokerT<LadderBook<1 << 16>>;
+    using RiskBrokerImplT = BrokerT<LadderBook<1 << 16>, NullSink, 10, NullMetrics, PreTradeRisk>;
+    OrderFlowGenerator generator(OrderFlowConfig{});
+    std::vector<FlowEvent> events(count);
+    std::vector<HotOrder> orders(count);
+    for (size_t i = 0; i < events.size(); i++) {
+        generator.next(events[i], i < count / 4);
+        toHot(events[i].order_, orders[i]);
+    }
+
+    RiskConfig tight;
+    tight.limits_.maxPosition_ = 50;
+    tight.limits_.maxOrderNotional_ = 20 * OrderFlowConfig{}.mid_;
+    tight.limits_.maxOpenOrders_ = 1;
+    tight.bandBps_ = 1;
+
+    std::cout << "===============price ladder pre-trade risk===============" << std::endl;
+    double noRiskNs = std::numeric_limits<double>::max(), openNs = noRiskNs, tightNs = noRiskNs;
+    uint64_t openRejects = 0, tightRejects = 0;
+    for (int32_t rep = 0; rep < 3; rep++) {
+        noRiskNs = std::min(noRiskNs, runRiskFlow<BrokerImplT>(events, orders, RiskConfig(), openRejects));
+        openNs = std::min(openNs, runRiskFlow<RiskBrokerImplT>(events, orders, RiskConfig(), openRejects));
+        tightNs = std::min(tightNs, runRiskFlow<RiskBrokerImplT>(events, orders, tight, tightRejects));
+    }
+    std::cout << "each event without risk in :" << noRiskNs << "ns, with open limits in :" << openNs << "ns ("
+              << openRejects << " rejected), with tight limits in :" << tightNs << "ns (" << tightRejects
+              << " rejected)" << std::endl;
+    std::cout << std::endl << std::endl;
+}
+
+#ifdef TOB_PERF_COUNTERS
+// counters per call of insertOrder/cancelOrder/getOrderBook after preload passive orders, only the
+// events the machine exposes are printed
+template <class BrokerImplT>
+void benchPerf(const char* name, const std::vector<FlowEvent>& events, uint32_t preload) {
+    using EventT = PerfCounterGroup::Event;
+    const char* constOpNames[] = {"insertOrder", "cancelOrder", "getOrderBook"};
+
+    auto broker = std::make_unique<BrokerImplT>(events.size() + 1);
+    auto profile = std::make_unique<PerfProfile>();
+    if (!profile->group().available()) {
+        std::cout << "perf_event_open failed, check /proc/sys/kernel/perf_event_paranoid" << std::endl;
+        return;
+    }
+    Orderbook<10> ob;
+    for (size_t i = 0; i < events.size(); i++) {
+        if (i == preload) {
+            broker->setPerfProfile(profile.get());
+        }
+        const FlowEvent& event = events[i];
+        if (event.op_ == FlowOp::Cancel) {
+            broker->cancelOrder(event.order_);
+        } else {
+            broker->insertOrder(event.order_);
+        }
+        if (!(i & 7)) {
+            broker->getOrderBook(ob);
+        }
+    }
+    broker->setPerfProfile(nullptr);
+
+    std::cout << name << std::endl;
+    std::cout << "  " << std::left << std::setw(14) << "op" << std::right << std::setw(10) << "count";
+    for (uint32_t event = 0; event < PerfCounterGroup::EventCount; event++) {
+        if (profile->group().has(static_cast<EventT>(event))) {
+            std::cout << std::setw(16) << PerfCounterGroup::skEventNames[event];
+        }
+    }
+    const bool constHasIpc = profile->group().has(EventT::Instructions) && profile->group().has(EventT::Cycles);
+    std::cout << (constHasIpc ? "       ipc" : "") << std::endl;
+
+    for (uint32_t op = 0; op < PerfProfile::skOpCount; op++) {
+        const PerfProfile::OpTotals& totals = profile->totals(static_cast<PerfOp>(op));
+        const double constCount = totals.count_ ? totals.count_ : 1;
+        std::cout << "  " << std::left << std::setw(14) << constOpNames[op] << std::right << std::setw(10)
+                  << totals.count_ << std::fixed << std::setprecision(3);
+        for (uint32_t event = 0; event < PerfCounterGroup::EventCount; event++) {
+            if (profile->group().has(static_cast<EventT>(event))) {
+                std::cout << std::setw(16) << totals.values_[event] / constCount;
+            }
+        }
+        if (constHasIpc) {
+            const uint64_t constCycles = totals.values_[EventT::Cycles];
+            std::cout << std::setw(10) << (constCycles ? double(totals.values_[EventT::Instructions]) / constCycles : 0.0);
+        }
+        std::cout << std::defaultfloat << std::endl;
+    }
+}
+#endif
+
+// counters per order of each backend under the default flow, needs make PERF=1
+void benchPerfSuite(uint32_t count) {
+#ifdef TOB_PERF_COUNTERS
+    const OrderFlowConfig constConfig;
+    const uint32_t constPreload = count / 4;
+    OrderFlowGenerator generator(constConfig);
+    std::vector<FlowEvent> events(constPreload + count);
+    for (size_t i = 0; i < events.size(); i++) {
+        generator.next(events[i], i < constPreload);
+    }
+
+    std::cout << "===============perf counters per call===============" << std::endl;
+    benchPerf<BrokerT<MapBook>>("std::map + arena", events, constPreload);
+    benchPerf<BrokerT<LadderBook<1 << 16>>>("price ladder", events, constPreload);
+    benchPerf<BrokerT<BTreeBook<>>>("b+tree", events, constPreload);
+    std::cout << std::endl << std::endl;
+
+    // limit and market orders of both sides interleaved at random, every matching kernel runs in turn
+    // so the branch misses and icache misses of insertOrder show the cost of dispatching between them
+    OrderFlowConfig mixedConfig;
+    mixedConfig.cancelRatio_ = 0.1;
+    mixedConfig.marketRatio_ = 0.2;
+    mixedConfig.aggressiveRatio_ = 0.3;
+    OrderFlowGenerator mixedGenerator(mixedConfig);
+    for (size_t i = 0; i < events.size(); i++) {
+        mixedGenerator.next(events[i], i < constPreload);
+    }
+    std::cout << "===============perf counters per call, mixed order types===============" << std::endl;
+    benchPerf<BrokerT<LadderBook<1 << 16>>>("price ladder", events, constPreload);
+    std::cout << std::endl << std::endl;
+#else
+    (void)count;
+    std::cout << "built without perf counters, rebuild with: make clean && make PERF=1" << std::endl;
+#endif
+}
+
+// write about sizeMb of random orders in the csv layout of readme.txt
+void generateOrderCsv(const std::string& path, uint64_t sizeMb, const TickScale& tickScale) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("failed to create " + path);
+    }
+    out << "idx,time,price,volume,quote_type,order_type\n";
+
+    std::mt19937_64 rng(sizeMb);
+    const uint64_t constTargetBytes = sizeMb << 20;
+    const Price constMid = tickScale.toTicks(150);
+    const uint64_t constOpenNs = 9ull * 3600 * TimeConstant::skNsPerSecond;
+    const int32_t constDecimals = std::lround(std::log10(tickScale.scale_));
+    uint64_t written = 0;
+    for (uint64_t idx = 0; written < constTargetBytes; idx++) {
+        const uint64_t constTsNs = constOpenNs + idx * 397;
+        const uint64_t constSeconds = constTsNs / TimeConstant::skNsPerSecond;
+        const uint64_t constRandom = rng();
+        const Price constTicks = constMid + static_cast<Price>(constRandom >> 8) % 200 - 100;
+        const Price constUnits = constTicks * tickScale.tickSize_;
+
+        char line[128];
+        const int32_t constSize =
+            std::snprintf(line, sizeof(line), "%lu,2024-01-02 %02lu:%02lu:%02lu.%09lu,%ld.%0*ld,%lu,%s,%s\n", idx,
+                          constSeconds / 3600, constSeconds / 60 % 60, constSeconds % 60,
+                          constTsNs % TimeConstant::skNsPerSecond, constUnits / tickScale.scale_, constDecimals,
+                          constUnits % tickScale.scale_, (constRandom >> 40) % 100 + 1, (constRandom & 32) ? "BID" : "ASK",
+                          (constRandom % 20) ? "LIMIT" : "MARKET");
+        out.write(line, constSize);
+        written += constSize;
+    }
+}
+
+// the same fields through iostream and std::stof/std::stoull, as a reference for OrderCsvParser
+uint64_t parseOrderCsvWithIostream(const std::string& path, const TickScale& tickScale, uint64_t& checksum) {
+    std::ifstream in(path);
+    std::string line, field;
+    std::getline(in, line);
+    uint64_t count = 0;
+    Order order;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::getline(fields, field, ',');
+        order.coid_ = std::stoull(field);
+        std::getline(fields, field, ',');
+        const std::string constTime = field.substr(field.find(' ') + 1);
+        order.createTimeNs_ = ((std::stoull(constTime.substr(0, 2)) * 60 + std::stoull(constTime.substr(3, 2))) * 60 +
+                               std::stoull(constTime.substr(6, 2))) *
+                                  TimeConstant::skNsPerSecond +
+                              std::stoull(constTime.substr(9));
+        std::getline(fields, field, ',');
+        order.price_ = tickScale.toTicks(std::stof(field));
+        std::getline(fields, field, ',');
+        order.qty_ = order.remainQty_ = std::stoi(field);
+        std::getline(fields, field, ',');
+        order.side_ = (field == "BID") ? QuoteType::Buy : QuoteType::Sell;
+        std::getline(fields, field);
+        order.type_ = (field == "LIMIT") ? OrderType::Limit : OrderType::Market;
+        checksum += order.coid_ + order.price_ + order.qty_ + order.createTimeNs_;
+        ++count;
+    }
+    return count;
+}
+
+// parse a multi-GB order csv (generated when missing) with OrderCsvParser and with iostream
+void benchCsv(const std::string& path, uint64_t sizeMb) {
+    std::cout << "===============order csv parser===============" << std::endl;
+    TscClock& clock = TscClock::getInstance();
+    const TickScale tickScale;
+    if (!std::ifstream(path)) {
+        generateOrderCsv(path, sizeMb, tickScale);
+    }
+    const double constMb = static_cast<double>(std::ifstream(path, std::ios::ate | std::ios::binary).tellg()) / (1 << 20);
+
+    uint64_t checksum = 0;
+    OrderCsvParser parser(tickScale);
+    uint64_t beginTick = clock.rdTsc();
+    const uint64_t constCount = parser.parseFile(path, [&](std::span<const Order> orders) {
+        for (const Order& o : orders) {
+            checksum += o.coid_ + o.price_ + o.qty_ + o.createTimeNs_;
+        }
+    });
+    const double constSimdSec = clock.tsc2Ns(clock.rdTsc() - beginTick) / 1e9;
+    std::cout << "OrderCsvParser: " << constCount << " orders of " << constMb << "MB in " << constSimdSec << "s, "
+              << constMb / constSimdSec << " MB/s, " << constCount / constSimdSec / 1e6 << " M orders/s" << std::endl;
+
+    uint64_t referenceChecksum = 0;
+    beginTick = clock.rdTsc();
+    const uint64_t constReferenceCount = parseOrderCsvWithIostream(path, tickScale, referenceChecksum);
+    const double constReferenceSec = clock.tsc2Ns(clock.rdTsc() - beginTick) / 1e9;
+    std::cout << "iostream + std::stof: " << constReferenceCount << " orders in " << constReferenceSec << "s, "
+              << constMb / constReferenceSec << " MB/s, " << constReferenceCount / constReferenceSec / 1e6
+              << " M orders/s" << std::endl;
+    std::cout << "speedup: " << constReferenceSec / constSimdSec
+              << "x, same orders: " << (constCount == constReferenceCount && checksum == referenceChecksum) << std::endl;
+}
+
+// replay a converted order file into a book, as fast as possible or at the recorded pace
+template <class BrokerImplT>
+void runReplay(const char* path, ReplayPace pace) {
+    TscClock& clock = TscClock::getInstance();
+    const ReplayFile file(path);
+    const TickScale constTickScale = file.tickScale();
+    auto broker = std::make_unique<BrokerImplT>(std::max<uint64_t>(file.records().size(), 1));
+
+    const ReplayStats constStats = replay(file, *broker, pace);
+    std::cout << "replayed " << constStats.inserts_ << " inserts and " << constStats.cancels_ << " cancels in "
+              << clock.tsc2Ns(constStats.elapsedTicks_) / 1e6 << "ms, "
+              << file.records().size() * 1e3 / std::max<uint64_t>(clock.tsc2Ns(constStats.elapsedTicks_), 1)
+              << " M events/s" << std::endl;
+    if (pace == ReplayPace::Recorded) {
+        std::cout << constStats.lateEvents_ << " events late, max " << clock.tsc2Ns(constStats.maxLateTicks_) << "ns"
+                  << std::endl;
+    }
+
+    Orderbook<10> ob;
+    broker->getOrderBook(ob);
+    showOrderBook(ob, constTickScale);
+}
+
+// behaviour checks of ./tob check, a failed check prints its line and the run exits with -1
+uint32_t checkFailures = 0;
+#define TOB_CHECK(cond)                                                                                  \
+    do {                                                                                                 \
+        if (!(cond)) {                                                                                   \
+            std::cout << __FILE__ << ":" << __LINE__ << " check failed: " << #cond << std::endl; \
+            ++checkFailures;                                                                             \
+        }                                                                                                \
+    } while (0)
+
+Order makeOrder(uint64_t coid, QuoteType side, OrderType type, Price price, Qty qty,
+                TimeInForce tif = TimeInForce::Unknown) {
+    Order order;
+    order.coid_ = coid;
+    order.side_ = side;
+    order.type_ = type;
+    order.price_ = price;
+    order.qty_ = order.remainQty_ = qty;
+    order.tif_ = tif;
+    return order;
+}
+
+// trades and execution reports the broker emitted since the previous call
+struct CheckEvents {
+    std::vector<Trade> trades_;
+    std::vector<ExecReport> reports_;
+
+    template <class BrokerImplT>
+    void drain(BrokerImplT& broker) {
+        trades_.clear();
+        reports_.clear();
+        broker.sink().drain([&](const BrokerEvent& event) {
+            if (event.type_ == EventType::Trade) {
+                trades_.push_back(event.trade_);
+            } else {
+                reports_.push_back(event.report_);
+            }
+        });
+    }
+
+    bool traded(size_t i, uint64_t bid, uint64_t ask, Price price, Qty qty) const {
+        return i < trades_.size() && trades_[i].bidOrderId_ == bid && trades_[i].askOrderId_ == ask &&
+               trades_[i].price_ == price && trades_[i].qty_ == qty;
+    }
+
+    bool reported(uint64_t coid, OrderStatus status) const {
+        return std::any_of(reports_.begin(), reports_.end(), [&](const ExecReport& report) {
+            return report.coid_ == coid && report.status_ == status;
+        });
+    }
+};
+
+template <size_t DEPTH>
+bool bookIs(const Orderbook<DEPTH>& ob, std::initializer_list<PriceLevel> bids, std::initializer_list<PriceLevel> asks) {
+    if (ob.bidSize_ != bids.size() || ob.askSize_ != asks.size()) {
+        return false;
+    }
+    size_t i = 0;
+    for (const PriceLevel& level : bids) {
+        if (ob.bids_[i].price_ != level.price_ || ob.bids_[i].qty_ != level.qty_) {
+            return false;
+        }
+        i++;
+    }
+    i = 0;
+    for (const PriceLevel& level : asks) {
+        if (ob.asks_[i].price_ != level.price_ || ob.asks_[i].qty_ != level.qty_) {
+            return false;
+        }
+        i++;
+    }
+    return true;
+}
+
+template <class BrokerImplT>
+Orderbook<10> bookOf(BrokerImplT& broker) {
+    Orderbook<10> ob;
+    broker.getOrderBook(ob);
+    return ob;
+}
+
+// ladder: prices outside the window go to the overflow in priority order, the window is re-anchored on
+// the next price once it runs empty and takes the overflow levels falling into it
+void checkLadder() {
+    BrokerArena arena(1 << 20, BrokerArena::skOnDemand);
+    LadderBookSide<QuoteType::Sell, int32_t, 64> asks(arena);
+    std::vector<Price> prices;
+    auto pricesOf = [&](const auto& side) {
+        prices.clear();
+        side.forEach([&](Price price, int32_t) {
+            prices.push_back(price);
+            return true;
+        });
+        return prices;
+    };
+
+    // window 968..1031 around the first price
+    asks.emplace(1000, 1);
+    asks.emplace(1100, 2);
+    asks.emplace(900, 3);
+    asks.emplace(1031, 4);
+    asks.emplace(1032, 5);
+    TOB_CHECK(asks.size() == 5 && asks.bestPrice() == 900 && asks.best() == 3);
+    TOB_CHECK(pricesOf(asks) == std::vector<Price>({900, 1000, 1031, 1032, 1100}));
+    TOB_CHECK(!asks.emplace(1000, 9).second && *asks.find(1000) == 1);
+
+    asks.popBest();
+    TOB_CHECK(asks.bestPrice() == 1000 && !asks.find(900));
+    asks.erase(1000);
+    asks.erase(1031);
+    TOB_CHECK(asks.size() == 2 && asks.bestPrice() == 1032 && asks.best() == 5);
+
+    // the window is empty, 1050 re-anchors it to 1018..1081 and 1032 moves in
+    asks.emplace(1050, 6);
+    TOB_CHECK(pricesOf(asks) == std::vector<Price>({1032, 1050, 1100}));
+    TOB_CHECK(asks.bestPrice() == 1032 && *asks.find(1032) == 5 && *asks.find(1100) == 2);
+    asks.popBest();
+    asks.popBest();
+    asks.popBest();
+    TOB_CHECK(asks.empty() && asks.bestPrice() == SideTraits<QuoteType::Sell>::skWorstPrice);
+
+    // a sell sweeping bids in the window and in the overflow below it fills in price priority
+    auto broker = std::make_unique<BrokerT<LadderBook<64>, EventRing<1024>>>();
+    CheckEvents events;
+    broker->insertOrder(makeOrder(1, QuoteType::Buy, OrderType::Limit, 1000, 10));
+    broker->insertOrder(makeOrder(2, QuoteType::Buy, OrderType::Limit, 960, 5));
+    broker->insertOrder(makeOrder(3, QuoteType::Buy, OrderType::Limit, 1020, 3));
+    events.drain(*broker);
+    broker->insertOrder(makeOrder(4, QuoteType::Sell, OrderType::Limit, 950, 15));
+    events.drain(*broker);
+    TOB_CHECK(events.trades_.size() == 3 && events.traded(0, 3, 4, 1020, 3) && events.traded(1, 1, 4, 1000, 10) &&
+              events.traded(2, 2, 4, 960, 2));
+    TOB_CHECK(bookIs(bookOf(*broker), {{960, 3}}, {}));
+}
+
+// b+tree: full leaves and inner nodes split and grow the tree, emptied leaves are dropped and the root
+// collapses back to a single leaf, against std::set under random inserts and erases
+void checkBTree() {
+    using AsksT = BTreeBookSide<QuoteType::Sell, int32_t, 4>;
+    using BidsT = BTreeBookSide<QuoteType::Buy, int32_t, 4>;
+    BrokerArena arena(1 << 20, BrokerArena::skOnDemand);
+    auto asks = std::make_unique<AsksT>(arena);
+    auto inOrder = [](const auto& side, const auto& expected) {
+        std::vector<Price> prices;
+        side.forEach([&](Price price, int32_t value) {
+            prices.push_back(price);
+            return value == static_cast<int32_t>(price);
+        });
+        return prices.size() == side.size() &&
+               std::equal(prices.begin(), prices.end(), expected.begin(), expected.end());
+    };
+
+    // ascending prices with a fanout of 4: the 5th splits the root leaf, the 11th the root inner node
+    std::set<Price> expected;
+    for (Price price = 1; price <= 11; price++) {
+        TOB_CHECK(asks->emplace(price, static_cast<int32_t>(price)).second);
+        expected.insert(price);
+        TOB_CHECK(asks->height() == (price < 5 ? 0u : price < 11 ? 1u : 2u));
+        TOB_CHECK(inOrder(*asks, expected));
+    }
+    for (Price price = 1; price <= 11; price++) {
+        TOB_CHECK(asks->find(price) && *asks->find(price) == price);
+    }
+    TOB_CHECK(!asks->find(0) && !asks->find(12));
+
+    // down to one price the other leaves are gone and a single leaf is the root again
+    for (Price price = 11; price > 1; price--) {
+        asks->erase(price);
+    }
+    TOB_CHECK(asks->size() == 1 && asks->height() == 0 && asks->bestPrice() == 1);
+    // the last leaf running empty while inner nodes exist leaves an empty single leaf
+    for (Price price = 2; price <= 11; price++) {
+        asks->emplace(price, static_cast<int32_t>(price));
+    }
+    while (!asks->empty()) {
+        asks->popBest();
+    }
+    TOB_CHECK(asks->height() == 0 && asks->bestPrice() == SideTraits<QuoteType::Sell>::skWorstPrice);
+    TOB_CHECK(asks->emplace(7, 7).second && asks->size() == 1 && asks->bestPrice() == 7);
+
+    auto bids = std::make_unique<BidsT>(arena);
+    std::set<Price, std::greater<Price>> bidSet;
+    std::mt19937_64 rng(7);
+    for (uint32_t i = 0; i < 20000; i++) {
+        const Price price = static_cast<Price>(rng() % 500);
+        if (rng() % 3) {
+            TOB_CHECK(bids->emplace(price, static_cast<int32_t>(price)).second == bidSet.insert(price).second);
+        } else {
+            bids->erase(price);
+            bidSet.erase(price);
+        }
+        if (!(i % 97)) {
+            TOB_CHECK(inOrder(*bids, bidSet));
+            TOB_CHECK(bids->bestPrice() ==
+                      (bidSet.empty() ? SideTraits<QuoteType::Buy>::skWorstPrice : *bidSet.begin()));
+        }
+    }
+    TOB_CHECK(inOrder(*bids, bidSet));
+}
+
+// coids: cancels of coids which are not resting change nothing, a coid already resting is rejected before
+// it can trade, and a full order index refuses an order until a cancel frees a slot
+void checkCoids() {
+    CheckEvents events;
+    auto broker = std::make_unique<BrokerT<MapBook, EventRing<1024>>>(2);
+    broker->insertOrder(makeOrder(1, QuoteType::Buy, OrderType::Limit, 100, 5));
+    broker->insertOrder(makeOrder(2, QuoteType::Sell, OrderType::Limit, 101, 5));
+    events.drain(*broker);
+
+    TOB_CHECK(!broker->cancelOrder(3));
+    TOB_CHECK(!broker->amendOrder(3, 100, 10));
+    const uint64_t constUnknown[] = {3, 4, 5};
+    TOB_CHECK(broker->cancelOrders(constUnknown) == 0);
+    events.drain(*broker);
+    TOB_CHECK(events.trades_.empty() && events.reports_.empty());
+    TOB_CHECK(bookIs(bookOf(*broker), {{100, 5}}, {{101, 5}}));
+
+    // coid 1 would cross the ask, and coid 2 its own resting order
+    broker->insertOrder(makeOrder(1, QuoteType::Buy, OrderType::Limit, 101, 3));
+    broker->insertOrder(makeOrder(2, QuoteType::Buy, OrderType::Limit, 101, 3));
+    events.drain(*broker);
+    TOB_CHECK(events.trades_.empty() && events.reports_.size() == 2 &&
+              events.reported(1, OrderStatus::Rejected) && events.reported(2, OrderStatus::Rejected));
+    TOB_CHECK(bookIs(bookOf(*broker), {{100, 5}}, {{101, 5}}));
+
+    // a canceled coid is free again, twice canceled only once
+    const uint64_t constTwice[] = {1, 1};
+    TOB_CHECK(broker->cancelOrders(constTwice) == 1);
+    broker->insertOrder(makeOrder(1, QuoteType::Buy, OrderType::Limit, 99, 4));
+    TOB_CHECK(bookIs(bookOf(*broker), {{99, 4}}, {{101, 5}}));
+
+    // the index holds 2 orders: the 3rd is refused, and after a cancel the freed slot takes one again
+    bool full = false;
+    try {
+        broker->insertOrder(makeOrder(3, QuoteType::Buy, OrderType::Limit, 98, 1));
+    } catch (const std::out_of_range&) {
+        full = true;
+    }
+    TOB_CHECK(full);
+    TOB_CHECK(!broker->cancelOrder(3) && broker->cancelOrder(2));
+    broker->insertOrder(makeOrder(3, QuoteType::Buy, OrderType::Limit, 98, 1));
+    TOB_CHECK(bookIs(bookOf(*broker), {{99, 4}, {98, 1}}, {}));
+}
+
+// amend: a reduction keeps the queue position, an increase or a new price goes to the tail of the level,
+// a price crossing the spread trades like an incoming limit order and the order is canceled once the new
+// qty is no more than its filled qty
+void checkAmend() {
+    CheckEvents events;
+    auto broker = std::make_unique<BrokerT<MapBook, EventRing<1024>>>();
+    broker->insertOrder(makeOrder(1, QuoteType::Buy, OrderType::Limit, 100, 5));
+    broker->insertOrder(makeOrder(2, QuoteType::Buy, OrderType::Limit, 100, 5));
+    TOB_CHECK(broker->amendOrder(1, 100, 3));
+    TOB_CHECK(bookIs(bookOf(*broker), {{100, 8}}, {}));
+    broker->insertOrder(makeOrder(10, QuoteType::Sell, OrderType::Limit, 100, 4));
+    events.drain(*broker);
+    TOB_CHECK(events.trades_.size() == 2 && events.traded(0, 1, 10, 100, 3) && events.traded(1, 2, 10, 100, 1));
+
+    broker->insertOrder(makeOrder(3, QuoteType::Buy, OrderType::Limit, 100, 2));
+    TOB_CHECK(broker->amendOrder(2, 100, 7));
+    broker->insertOrder(makeOrder(11, QuoteType::Sell, OrderType::Limit, 100, 3));
+    events.drain(*broker);
+    TOB_CHECK(events.trades_.size() == 2 && events.traded(0, 3, 11, 100, 2) && events.traded(1, 2, 11, 100, 1));
+    TOB_CHECK(bookIs(bookOf(*broker), {{100, 5}}, {}));
+
+    broker->insertOrder(makeOrder(4, QuoteType::Buy, OrderType::Limit, 99, 2));
+    broker->insertOrder(makeOrder(5, QuoteType::Buy, OrderType::Limit, 98, 2));
+    TOB_CHECK(broker->amendOrder(5, 99, 2));
+    TOB_CHECK(bookIs(bookOf(*broker), {{100, 5}, {99, 4}}, {}));
+    broker->insertOrder(makeOrder(12, QuoteType::Sell, OrderType::Limit, 99, 6));
+    events.drain(*broker);
+    TOB_CHECK(events.trades_.size() == 2 && events.traded(0, 2, 12, 100, 5) && events.traded(1, 4, 12, 99, 1));
+    TOB_CHECK(bookIs(bookOf(*broker), {{99, 3}}, {}));
+
+    // 5 moved up through the ask at 101 takes it, the rest of 5 rests at 101 under its own coid
+    broker->insertOrder(makeOrder(13, QuoteType::Sell, OrderType::Limit, 101, 1));
+    TOB_CHECK(broker->amendOrder(5, 101, 4));
+    events.drain(*broker);
+    TOB_CHECK(events.trades_.size() == 1 && events.traded(0, 5, 13, 101, 1));
+    TOB_CHECK(bookIs(bookOf(*broker), {{101, 3}, {99, 1}}, {}));
+    broker->insertOrder(makeOrder(14, QuoteType::Sell, OrderType::Limit, 101, 1));
+    events.drain(*broker);
+    TOB_CHECK(events.trades_.size() == 1 && events.traded(0, 5, 14, 101, 1));
+
+    // 5 filled 2 of 4, amended to 2 nothing remains
+    TOB_CHECK(broker->amendOrder(5, 101, 2));
+    events.drain(*broker);
+    TOB_CHECK(events.reported(5, OrderStatus::Canceled));
+    TOB_CHECK(bookIs(bookOf(*broker), {{99, 1}}, {}));
+    TOB_CHECK(!broker->amendOrder(5, 101, 4));
+}
+
+// fill or kill: short by one lot at the limit the order is canceled and the book untouched, the exact
+// depth fills it, IOC takes what is there. the depth window is the smallest one so levels also lie
+// outside of it on both ends
+void checkFillOrKill() {
+    CheckEvents events;
+    using BrokerImplT = BrokerT<MapBook, EventRing<1024>>;
+    const uint32_t constTicks = DepthIndex<QuoteType::Buy>::skPageTicks;
+    auto broker = std::make_unique<BrokerImplT>(BrokerImplT::skDefaultMaxOrders, BrokerArena::skOnDemand, constTicks);
+    const Price constFar = 1000 + 2 * constTicks;
+    broker->insertOrder(makeOrder(1, QuoteType::Sell, OrderType::Limit, 1000, 3));
+    broker->insertOrder(makeOrder(2, QuoteType::Sell, OrderType::Limit, 1002, 4));
+    broker->insertOrder(makeOrder(3, QuoteType::Sell, OrderType::Limit, constFar, 5));
+    broker->insertOrder(makeOrder(4, QuoteType::Sell, OrderType::Limit, 900, 2));
+    events.drain(*broker);
+
+    // 2 + 3 + 4 lots up to 1002, 5 more at constFar
+    broker->insertOrder(makeOrder(10, QuoteType::Buy, OrderType::Limit, 1002, 10, TimeInForce::FOK));
+    broker->insertOrder(makeOrder(11, QuoteType::Buy, OrderType::Limit, constFar, 15, TimeInForce::FOK));
+    broker->insertOrder(makeOrder(12, QuoteType::Buy, OrderType::Limit, 899, 1, TimeInForce::FOK));
+    events.drain(*broker);
+    TOB_CHECK(events.trades_.empty() && events.reported(10, OrderStatus::Canceled) &&
+              events.reported(11, OrderStatus::Canceled) && events.reported(12, OrderStatus::Canceled));
+    TOB_CHECK(bookIs(bookOf(*broker), {}, {{900, 2}, {1000, 3}, {1002, 4}, {constFar, 5}}));
+
+    broker->insertOrder(makeOrder(13, QuoteType::Buy, OrderType::Limit, constFar, 14, TimeInForce::FOK));
+    events.drain(*broker);
+    TOB_CHECK(events.trades_.size() == 4 && events.traded(0, 13, 4, 900, 2) && events.traded(3, 13, 3, constFar, 5));
+    TOB_CHECK(bookIs(bookOf(*broker), {}, {}));
+
+    broker->insertOrder(makeOrder(5, QuoteType::Sell, OrderType::Limit, 1001, 3));
+    broker->insertOrder(makeOrder(14, QuoteType::Buy, OrderType::Limit, 1001, 5, TimeInForce::IOC));
+    events.drain(*broker);
+    TOB_CHECK(events.trades_.size() == 1 && events.traded(0, 14, 5, 1001, 3) &&
+              events.reported(14, OrderStatus::Canceled));
+    TOB_CHECK(bookIs(bookOf(*broker), {}, {}));
+
+    // the same on the bid side, the window re-anchored on the new prices
+    broker->insertOrder(makeOrder(6, QuoteType::Buy, OrderType::Limit, 500, 3));
+    broker->insertOrder(makeOrder(7, QuoteType::Buy, OrderType::Limit, 500 + 3 * constTicks, 3));
+    broker->insertOrder(makeOrder(15, QuoteType::Sell, OrderType::Limit, 500, 7, TimeInForce::FOK));
+    broker->insertOrder(makeOrder(16, QuoteType::Sell, OrderType::Limit, 501, 4, TimeInForce::FOK));
+    events.drain(*broker);
+    TOB_CHECK(events.trades_.empty() && events.reported(15, OrderStatus::Canceled) &&
+              events.reported(16, OrderStatus::Canceled));
+    broker->insertOrder(makeOrder(17, QuoteType::Sell, OrderType::Limit, 500, 6, TimeInForce::FOK));
+    events.drain(*broker);
+    TOB_CHECK(events.trades_.size() == 2 && events.traded(0, 7, 17, 500 + 3 * constTicks, 3) &&
+              events.traded(1, 6, 17, 500, 3));
+
+    // limits on the top tick of the window, anchored constTicks / 2 below the first price
+    const Price constTop = 10000 + constTicks / 2 - 1;
+    broker->insertOrder(makeOrder(8, QuoteType::Sell, OrderType::Limit, 10000, 2));
+    broker->insertOrder(makeOrder(9, QuoteType::Sell, OrderType::Limit, constTop, 2));
+    broker->insertOrder(makeOrder(18, QuoteType::Buy, OrderType::Limit, constTop, 5, TimeInForce::FOK));
+    events.drain(*broker);
+    TOB_CHECK(events.trades_.empty() && events.reported(18, OrderStatus::Canceled));
+    broker->insertOrder(makeOrder(19, QuoteType::Buy, OrderType::Limit, constTop, 4, TimeInForce::FOK));
+    events.drain(*broker);
+    TOB_CHECK(events.trades_.size() == 2 && events.traded(1, 19, 9, constTop, 2));
+
+    broker->insertOrder(makeOrder(20, QuoteType::Buy, OrderType::Limit, 10000, 2));
+    broker->insertOrder(makeOrder(21, QuoteType::Buy, OrderType::Limit, constTop, 2));
+    broker->insertOrder(makeOrder(22, QuoteType::Sell, OrderType::Limit, constTop, 3, TimeInForce::FOK));
+    broker->insertOrder(makeOrder(23, QuoteType::Sell, OrderType::Limit, 10000 - constTicks / 2, 5, TimeInForce::FOK));
+    events.drain(*broker);
+    TOB_CHECK(events.trades_.empty() && events.reported(22, OrderStatus::Canceled) &&
+              events.reported(23, OrderStatus::Canceled));
+    broker->insertOrder(makeOrder(24, QuoteType::Sell, OrderType::Limit, constTop, 2, TimeInForce::FOK));
+    broker->insertOrder(makeOrder(25, QuoteType::Sell, OrderType::Limit, 10000 - constTicks / 2, 2, TimeInForce::FOK));
+    events.drain(*broker);
+    TOB_CHECK(events.trades_.size() == 2 && events.traded(0, 21, 24, constTop, 2) &&
+              events.traded(1, 20, 25, 10000, 2));
+    TOB_CHECK(bookIs(bookOf(*broker), {}, {}));
+}
+
+// market protection: a market order sweeps up to bandBps_ through the best price it arrives at, rounded up to at
+// least one tick, its remainder is canceled or with Limit rests at the bound unless it is IOC or FOK, a FOK order
+// is filled within the bound or not at all. a remainder resting at its bound is checked by risk like a limit order
+void checkProtection() {
+    CheckEvents events;
+    auto protectedBroker = std::make_unique<BrokerT<MapBook, EventRing<1024>>>();
+    protectedBroker->setMarketProtection(MarketProtection{100});
+    auto insertAll = [&](std::initializer_list<Order> orders) {
+        for (const Order& order : orders) {
+            protectedBroker->insertOrder(order);
+        }
+        events.drain(*protectedBroker);
+    };
+
+    // 100 bps of 10000 is 100 ticks
+    insertAll({makeOrder(100, QuoteType::Sell, OrderType::Limit, 10000, 2),
+               makeOrder(101, QuoteType::Sell, OrderType::Limit, 10050, 2),
+               makeOrder(102, QuoteType::Sell, OrderType::Limit, 10100, 2),
+               makeOrder(103, QuoteType::Sell, OrderType::Limit, 10101, 2)});
+    insertAll({makeOrder(1, QuoteType::Buy, OrderType::Market, 0, 10)});
+    TOB_CHECK(events.trades_.size() == 3 && events.traded(0, 1, 100, 10000, 2) && events.traded(2, 1, 102, 10100, 2));
+    TOB_CHECK(events.reported(1, OrderStatus::Canceled));
+    TOB_CHECK(bookIs(bookOf(*protectedBroker), {}, {{10101, 2}}));
+
+    protectedBroker->setMarketProtection(MarketProtection{100, MarketRemainder::Limit});
+    insertAll({makeOrder(104, QuoteType::Sell, OrderType::Limit, 10000, 2),
+               makeOrder(2, QuoteType::Buy, OrderType::Market, 0, 5)});
+    TOB_CHECK(events.trades_.size() == 1 && events.traded(0, 2, 104, 10000, 2) &&
+              events.reported(2, OrderStatus::PartiallyFilled) && !events.reported(2, OrderStatus::New));
+    TOB_CHECK(bookIs(bookOf(*protectedBroker), {{10100, 3}}, {{10101, 2}}));
+    TOB_CHECK(protectedBroker->cancelOrder(2));
+
+    // IOC cancels the remainder whatever the remainder mode, the band of 10101 is 102 ticks
+    insertAll({makeOrder(105, QuoteType::Sell, OrderType::Limit, 10203, 1),
+               makeOrder(106, QuoteType::Sell, OrderType::Limit, 10204, 1),
+               makeOrder(3, QuoteType::Buy, OrderType::Market, 0, 5, TimeInForce::IOC)});
+    TOB_CHECK(events.trades_.size() == 2 && events.traded(0, 3, 103, 10101, 2) && events.traded(1, 3, 105, 10203, 1));
+    TOB_CHECK(events.reported(3, OrderStatus::Canceled));
+    TOB_CHECK(bookIs(bookOf(*protectedBroker), {}, {{10204, 1}}));
+
+    // FOK: 2 lots within the bound of 10100, the 5 lots at 10200 are outside of it
+    insertAll({makeOrder(107, QuoteType::Sell, OrderType::Limit, 10000, 2),
+               makeOrder(4, QuoteType::Buy, OrderType::Market, 0, 3, TimeInForce::FOK)});
+    TOB_CHECK(events.trades_.empty() && events.reported(4, OrderStatus::Canceled));
+    insertAll({makeOrder(5, QuoteType::Buy, OrderType::Market, 0, 2, TimeInForce::FOK)});
+    TOB_CHECK(events.trades_.size() == 1 && events.traded(0, 5, 107, 10000, 2));
+    TOB_CHECK(bookIs(bookOf(*protectedBroker), {}, {{10204, 1}}));
+
+    // sell side: the bound is 9900, the remainder rests there as an ask
+    insertAll({makeOrder(108, QuoteType::Buy, OrderType::Limit, 10000, 2),
+               makeOrder(109, QuoteType::Buy, OrderType::Limit, 9900, 2),
+               makeOrder(110, QuoteType::Buy, OrderType::Limit, 9899, 1),
+               makeOrder(6, QuoteType::Sell, OrderType::Market, 0, 5)});
+    TOB_CHECK(events.trades_.size() == 2 && events.traded(0, 108, 6, 10000, 2) && events.traded(1, 109, 6, 9900, 2));
+    TOB_CHECK(bookIs(bookOf(*protectedBroker), {{9899, 1}}, {{9900, 1}, {10204, 1}}));
+
+    // no opposite price to bound by: nothing trades and nothing rests
+    TOB_CHECK(protectedBroker->cancelOrder(110));
+    insertAll({makeOrder(7, QuoteType::Sell, OrderType::Market, 0, 1)});
+    TOB_CHECK(events.trades_.empty() && events.reported(7, OrderStatus::Canceled));
+    TOB_CHECK(bookIs(bookOf(*protectedBroker), {}, {{9900, 1}, {10204, 1}}));
+
+    // 100 bps of 10 ticks is less than a tick and rounded up to one
+    protectedBroker->reset();
+    protectedBroker->setMarketProtection(MarketProtection{100});
+    insertAll({makeOrder(111, QuoteType::Sell, OrderType::Limit, 10, 1),
+               makeOrder(112, QuoteType::Sell, OrderType::Limit, 11, 1),
+               makeOrder(113, QuoteType::Sell, OrderType::Limit, 12, 1),
+               makeOrder(8, QuoteType::Buy, OrderType::Market, 0, 3)});
+    TOB_CHECK(events.trades_.size() == 2 && events.traded(1, 8, 112, 11, 1) &&
+              events.reported(8, OrderStatus::Canceled));
+    TOB_CHECK(bookIs(bookOf(*protectedBroker), {}, {{12, 1}}));
+
+    using RiskBrokerImplT = BrokerT<MapBook, EventRing<1024>, 10, NullMetrics, PreTradeRisk>;
+    auto broker = std::make_unique<RiskBrokerImplT>();
+    RiskConfig config;
+    config.limits_.maxOpenOrders_ = 1;
+    broker->risk().configure(config);
+    broker->setMarketProtection(MarketProtection{100, MarketRemainder::Limit});
+
+    // trader 1 has its one open order, the remainder of its market order would be a second one
+    const uint64_t constSecond = (uint64_t{1} << 32) | 1;
+    broker->insertOrder(makeOrder(1, QuoteType::Buy, OrderType::Limit, 9000, 1));
+    broker->insertOrder(makeOrder(100, QuoteType::Sell, OrderType::Limit, 10000, 2));
+    broker->insertOrder(makeOrder(constSecond, QuoteType::Buy, OrderType::Market, 0, 5));
+    events.drain(*broker);
+    TOB_CHECK(events.trades_.size() == 1 && events.traded(0, constSecond, 100, 10000, 2) &&
+              events.reported(constSecond, OrderStatus::Rejected));
+    TOB_CHECK(bookIs(bookOf(*broker), {{9000, 1}}, {}));
+    TOB_CHECK(broker->risk().trader(1).openOrders_ == 1 && broker->risk().trader(1).openBuyQty_ == 1 &&
+              broker->risk().trader(1).position_ == 2);
+    TOB_CHECK(broker->risk().rejects(PreTradeRisk::OpenOrders) == 1);
+
+    // trader 2 has none, its remainder rests at the bound 100 ticks through the best ask
+    broker->insertOrder(makeOrder(101, QuoteType::Sell, OrderType::Limit, 10000, 2));
+    broker->insertOrder(makeOrder(2, QuoteType::Buy, OrderType::Market, 0, 5));
+    events.drain(*broker);
+    TOB_CHECK(events.trades_.size() == 1 && events.traded(0, 2, 101, 10000, 2));
+    TOB_CHECK(bookIs(bookOf(*broker), {{10100, 3}, {9000, 1}}, {}));
+    TOB_CHECK(broker->risk().trader(2).openOrders_ == 1 && broker->risk().trader(2).openBuyQty_ == 3);
+}
+
+// pre-trade risk: each reject reason on new orders and amends, a rejected amend leaves the order as it was, open
+// qty and orders follow rests, amends, fills and cancels back to zero, reset forgets them and keeps the positions
+void checkRisk() {
+    CheckEvents events;
+    using RiskBrokerImplT = BrokerT<MapBook, EventRing<1024>, 10, NullMetrics, PreTradeRisk>;
+    auto broker = std::make_unique<RiskBrokerImplT>();
+    RiskConfig config;
+    config.limits_ = RiskLimits{10, 100000, 2};
+    config.traders_ = 16;
+    config.bandBps_ = 100;
+    broker->risk().configure(config);
+    const PreTradeRisk& riskRef = broker->risk();
+    // the n-th order of trader
+    auto coidOf = [](uint64_t trader, uint64_t n) { return (n << 32) | trader; };
+    auto openIs = [&](uint16_t trader, uint32_t orders, int64_t buyQty, int64_t sellQty, int64_t position) {
+        const TraderRisk& traderRef = riskRef.trader(trader);
+        return traderRef.openOrders_ == orders && traderRef.openBuyQty_ == buyQty &&
+               traderRef.openSellQty_ == sellQty && traderRef.position_ == position;
+    };
+
+    broker->insertOrder(makeOrder(coidOf(2, 1), QuoteType::Sell, OrderType::Limit, 1100, 1));
+    broker->insertOrder(makeOrder(coidOf(1, 1), QuoteType::Buy, OrderType::Limit, 1000, 11));
+    broker->insertOrder(makeOrder(coidOf(1, 2), QuoteType::Buy, OrderType::Limit, 20000, 6));
+    broker->insertOrder(makeOrder(coidOf(1, 3), QuoteType::Buy, OrderType::Limit, 1000, 2));
+    broker->insertOrder(makeOrder(coidOf(1, 4), QuoteType::Buy, OrderType::Limit, 999, 2));
+    broker->insertOrder(makeOrder(coidOf(1, 5), QuoteType::Buy, OrderType::Limit, 998, 1));
+    // the band of 1100 is 11 ticks
+    broker->insertOrder(makeOrder(coidOf(3, 1), QuoteType::Buy, OrderType::Limit, 1112, 1));
+    broker->insertOrder(makeOrder(coidOf(20, 1), QuoteType::Buy, OrderType::Limit, 1000, 1));
+    events.drain(*broker);
+    TOB_CHECK(events.trades_.empty());
+    for (const uint64_t constCoid : {coidOf(1, 1), coidOf(1, 2), coidOf(1, 5), coidOf(3, 1), coidOf(20, 1)}) {
+        TOB_CHECK(events.reported(constCoid, OrderStatus::Rejected));
+    }
+    TOB_CHECK(riskRef.rejects(PreTradeRisk::Position) == 1 && riskRef.rejects(PreTradeRisk::Notional) == 1 &&
+              riskRef.rejects(PreTradeRisk::OpenOrders) == 1 && riskRef.rejects(PreTradeRisk::PriceBand) == 1 &&
+              riskRef.rejects(PreTradeRisk::UnknownTrader) == 1);
+    TOB_CHECK(bookIs(bookOf(*broker), {{1000, 2}, {999, 2}}, {{1100, 1}}));
+    TOB_CHECK(openIs(1, 2, 4, 0, 0) && openIs(2, 1, 0, 1, 0) && openIs(3, 0, 0, 0, 0));
+
+    // amends adding qty or moving the price are checked, a rejected one leaves the order as it was
+    TOB_CHECK(!broker->amendOrder(coidOf(1, 3), 1000, 9));
+    TOB_CHECK(broker->amendOrder(coidOf(1, 3), 1000, 8));
+    TOB_CHECK(!broker->amendOrder(coidOf(1, 4), 1112, 2));
+    TOB_CHECK(riskRef.rejects(PreTradeRisk::Position) == 2 && riskRef.rejects(PreTradeRisk::PriceBand) == 2);
+    TOB_CHECK(bookIs(bookOf(*broker), {{1000, 8}, {999, 2}}, {{1100, 1}}));
+    TOB_CHECK(openIs(1, 2, 10, 0, 0));
+
+    // moved through the ask it fills 1 lot and rests the other
+    TOB_CHECK(broker->amendOrder(coidOf(1, 4), 1100, 2));
+    events.drain(*broker);
+    TOB_CHECK(events.trades_.size() == 1 && events.traded(0, coidOf(1, 4), coidOf(2, 1), 1100, 1));
+    TOB_CHECK(openIs(1, 2, 9, 0, 1) && openIs(2, 0, 0, 0, -1));
+    TOB_CHECK(broker->amendOrder(coidOf(1, 3), 1000, 3));
+    TOB_CHECK(openIs(1, 2, 4, 0, 1));
+    TOB_CHECK(broker->cancelOrder(coidOf(1, 3)) && broker->cancelOrder(coidOf(1, 4)));
+    TOB_CHECK(openIs(1, 0, 0, 0, 1));
+
+    // the position counts: 9 more lots on top of the long 1 pass, 10 do not
+    broker->insertOrder(makeOrder(coidOf(1, 6), QuoteType::Buy, OrderType::Limit, 900, 10));
+    broker->insertOrder(makeOrder(coidOf(1, 7), QuoteType::Buy, OrderType::Limit, 900, 9));
+    broker->insertOrder(makeOrder(coidOf(2, 2), QuoteType::Sell, OrderType::Limit, 1200, 3));
+    TOB_CHECK(riskRef.rejects(PreTradeRisk::Position) == 3);
+    TOB_CHECK(openIs(1, 1, 9, 0, 1) && openIs(2, 1, 0, 3, -1));
+    broker->reset();
+    TOB_CHECK(openIs(1, 0, 0, 0, 1) && openIs(2, 0, 0, 0, -1));
+    TOB_CHECK(bookIs(bookOf(*broker), {}, {}));
+}
+
+// order index: reset empties it in O(1) by a new epoch, also across the wrap of the epoch, and slots of older
+// epochs are taken again by inserts and probes run past them
+void checkOrderIndex() {
+    OrderIndex<int32_t> index(64, BrokerArena::skOnDemand);
+    int32_t values[64];
+    for (int32_t round = 0; round < 70000; round++) {
+        const uint64_t constFirst = round % 3 * 64;
+        for (uint32_t i = 0; i < 48; i++) {
+            TOB_CHECK(index.insert(constFirst + i, &values[i % 64]));
+        }
+        if (!(round % 1000) || round > 65530) {
+            TOB_CHECK(index.size() == 48 && index.find(constFirst + 47) == &values[47] && !index.find(constFirst + 48));
+            TOB_CHECK(index.erase(constFirst + 3) == &values[3] && !index.find(constFirst + 3) && index.size() == 47);
+            TOB_CHECK(!index.insert(constFirst + 4, &values[0]));
+        }
+        index.reset();
+        TOB_CHECK(index.size() == 0);
+        if (!(round % 1000) || round > 65530) {
+            for (uint64_t key = 0; key < 3 * 64; key++) {
+                TOB_CHECK(!index.find(key));
+            }
+        }
+    }
+}
+
+// the first N levels of both sides of top are those of full
+template <size_t N, size_t M>
+bool sameTop(const Orderbook<N>& top, const Orderbook<M>& full) {
+    if (top.bidSize_ != std::min<size_t>(N, full.bidSize_) || top.askSize_ != std::min<size_t>(N, full.askSize_)) {
+        return false;
+    }
+    for (size_t i = 0; i < top.bidSize_; i++) {
+        if (top.bids_[i].price_ != full.bids_[i].price_ || top.bids_[i].qty_ != full.bids_[i].qty_) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < top.askSize_; i++) {
+        if (top.asks_[i].price_ != full.asks_[i].price_ || top.asks_[i].qty_ != full.asks_[i].qty_) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// top levels: after every random insert, market order, cancel, batch cancel and amend the incrementally kept
+// best levels and a snapshot following getOrderBookDelta are the best levels of a full book walk. the depth
+// of 4 is short, so levels leaving a full cache make it load the next ones from the book
+template <class BookT>
+void checkTopLevels() {
+    using BrokerImplT = BrokerT<BookT, NullSink, 4>;
+    auto broker = std::make_unique<BrokerImplT>();
+    std::mt19937_64 rng(11);
+    std::vector<uint64_t> coids;
+    Orderbook<4> top;
+    Orderbook<4> applied;
+    Orderbook<32> full;
+    OrderbookDelta<4> delta;
+    uint64_t nextCoid = 1;
+    bool same = true;
+    for (uint32_t step = 0; step < 20000 && same; step++) {
+        const uint32_t constOp = rng() % 16;
+        if (constOp < 9 || coids.empty()) {
+            const QuoteType constSide = (rng() & 1) ? QuoteType::Buy : QuoteType::Sell;
+            const Price constOffset = static_cast<Price>(rng() % 24) - 2;
+            const Price constPrice = (constSide == QuoteType::Buy) ? 1000 - constOffset : 1000 + constOffset;
+            const OrderType constType = (constOp == 8) ? OrderType::Market : OrderType::Limit;
+            broker->insertOrder(makeOrder(nextCoid, constSide, constType, constPrice, rng() % 9 + 1));
+            coids.push_back(nextCoid++);
+        } else if (constOp < 12) {
+            const size_t constAt = rng() % coids.size();
+            broker->cancelOrder(coids[constAt]);
+            coids[constAt] = coids.back();
+            coids.pop_back();
+        } else if (constOp < 13) {
+            const uint64_t constBatch[] = {coids[rng() % coids.size()], coids[rng() % coids.size()], nextCoid};
+            broker->cancelOrders(constBatch);
+        } else {
+            const uint64_t constCoid = coids[rng() % coids.size()];
+            broker->amendOrder(constCoid, 990 + static_cast<Price>(rng() % 21), rng() % 12 + 1);
+        }
+
+        broker->getOrderBook(top);
+        broker->getOrderBook(full);
+        broker->getOrderBookDelta(delta);
+        delta.applyTo(applied);
+        same = sameTop(top, full) && sameTop(applied, full);
+    }
+    TOB_CHECK(same);
+}
+
+// same events, field by field, in the same order
+bool sameEvents(const std::vector<BrokerEvent>& lhs, const std::vector<BrokerEvent>& rhs) {
+    return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const BrokerEvent& l, const BrokerEvent& r) {
+        return l.type_ == r.type_ && ((l.type_ == EventType::Trade)
+                                          ? !std::memcmp(&l.trade_, &r.trade_, sizeof(Trade))
+                                          : !std::memcmp(&l.report_, &r.report_, sizeof(ExecReport)));
+    });
+}
+
+// batches: insertOrders of wire and hot orders and cancelOrders give the events, books and cancel counts of
+// one call per order, with coids resting already, repeated within a batch or not resting at all
+void checkBatches() {
+    using BrokerImplT = BrokerT<MapBook, EventRing<1 << 14>>;
+    auto single = std::make_unique<BrokerImplT>();
+    auto batched = std::make_unique<BrokerImplT>();
+    std::mt19937_64 rng(13);
+    std::vector<Order> orders;
+    std::vector<HotOrder> hotOrders;
+    std::vector<uint64_t> coids;
+    std::vector<BrokerEvent> singleEvents;
+    std::vector<BrokerEvent> batchedEvents;
+    uint64_t nextCoid = 1;
+    bool same = true;
+    for (uint32_t round = 0; round < 2000 && same; round++) {
+        orders.clear();
+        const size_t constSize = rng() % 12 + 1;
+        for (size_t i = 0; i < constSize; i++) {
+            const QuoteType constSide = (rng() & 1) ? QuoteType::Buy : QuoteType::Sell;
+            const Price constOffset = static_cast<Price>(rng() % 20) - 3;
+            const Price constPrice = (constSide == QuoteType::Buy) ? 1000 - constOffset : 1000 + constOffset;
+            const OrderType constType = (rng() % 10) ? OrderType::Limit : OrderType::Market;
+            const TimeInForce constTif = (rng() % 8) ? TimeInForce::GTC : TimeInForce::FOK;
+            // a coid of the past, maybe resting, or a new one, maybe repeated later in the batch
+            const uint64_t constCoid = (rng() % 6 || nextCoid == 1) ? nextCoid++ : rng() % nextCoid + 1;
+            orders.push_back(makeOrder(constCoid, constSide, constType, constPrice, rng() % 9 + 1, constTif));
+        }
+
+        for (const Order& order : orders) {
+            single->insertOrder(order);
+        }
+        if (round & 1) {
+            hotOrders.resize(orders.size());
+            for (size_t i = 0; i < orders.size(); i++) {
+                toHot(orders[i], hotOrders[i]);
+            }
+            batched->insertOrders(std::span<const HotOrder>(hotOrders));
+        } else {
+            batched->insertOrders(std::span<const Order>(orders));
+        }
+
+        coids.clear();
+        for (size_t i = rng() % 6; i; i--) {
+            coids.push_back(rng() % (nextCoid + 2));
+        }
+        size_t canceled = 0;
+        for (const uint64_t constCoid : coids) {
+            canceled += single->cancelOrder(constCoid);
+        }
+        same = (batched->cancelOrders(coids) == canceled);
+
+        singleEvents.clear();
+        batchedEvents.clear();
+        single->sink().drain([&](const BrokerEvent& event) { singleEvents.push_back(event); });
+        batched->sink().drain([&](const BrokerEvent& event) { batchedEvents.push_back(event); });
+        Orderbook<32> singleBook;
+        Orderbook<32> batchedBook;
+        single->getOrderBook(singleBook);
+        batched->getOrderBook(batchedBook);
+        same = same && sameEvents(singleEvents, batchedEvents) &&
+               !std::memcmp(&singleBook, &batchedBook, sizeof(Orderbook<32>));
+    }
+    TOB_CHECK(same);
+}
+
+// events: a limit order sweeping three resting orders over two levels gives, per fill, the trade then the reports
+// of the resting and the incoming order, sequence numbers run on from the reports of the resting orders without a
+// gap. NullSink leaves the same book, a lagging EventRing drops the oldest events and the gap shows in seqNum_
+void checkEvents() {
+    auto ring = std::make_unique<BrokerT<MapBook, EventRing<1024>>>();
+    auto null = std::make_unique<BrokerT<MapBook, NullSink>>();
+    auto small = std::make_unique<BrokerT<MapBook, EventRing<4>>>();
+    auto insertAll = [&](const Order& order) {
+        ring->insertOrder(order);
+        null->insertOrder(order);
+        small->insertOrder(order);
+    };
+    insertAll(makeOrder(1, QuoteType::Sell, OrderType::Limit, 100, 2));
+    insertAll(makeOrder(2, QuoteType::Sell, OrderType::Limit, 100, 3));
+    insertAll(makeOrder(3, QuoteType::Sell, OrderType::Limit, 101, 4));
+    insertAll(makeOrder(10, QuoteType::Buy, OrderType::Limit, 101, 10));
+    TOB_CHECK(ring->cancelOrder(10) && null->cancelOrder(10) && small->cancelOrder(10));
+
+    std::vector<BrokerEvent> events;
+    ring->sink().drain([&](const BrokerEvent& event) { events.push_back(event); });
+    auto tradeIs = [&](size_t i, uint64_t tradeId, uint64_t ask, Price price, Qty qty) {
+        const Trade& tradeRef = events[i].trade_;
+        return events[i].type_ == EventType::Trade && tradeRef.seqNum_ == i + 1 && tradeRef.tradeId_ == tradeId &&
+               tradeRef.bidOrderId_ == 10 && tradeRef.askOrderId_ == ask && tradeRef.price_ == price &&
+               tradeRef.qty_ == qty && tradeRef.aggressorSide_ == QuoteType::Buy;
+    };
+    auto reportIs = [&](size_t i, uint64_t coid, OrderStatus status, Price price, Qty lastQty, Qty remainQty) {
+        const ExecReport& reportRef = events[i].report_;
+        return events[i].type_ == EventType::ExecReport && reportRef.seqNum_ == i + 1 && reportRef.coid_ == coid &&
+               reportRef.status_ == status && reportRef.price_ == price && reportRef.lastQty_ == lastQty &&
+               reportRef.remainQty_ == remainQty;
+    };
+    TOB_CHECK(events.size() == 13);
+    if (events.size() == 13) {
+        TOB_CHECK(reportIs(0, 1, OrderStatus::New, 100, 0, 2) && reportIs(1, 2, OrderStatus::New, 100, 0, 3) &&
+                  reportIs(2, 3, OrderStatus::New, 101, 0, 4));
+        TOB_CHECK(tradeIs(3, 1, 1, 100, 2) && reportIs(4, 1, OrderStatus::Filled, 100, 2, 0) &&
+                  reportIs(5, 10, OrderStatus::PartiallyFilled, 100, 2, 8));
+        TOB_CHECK(tradeIs(6, 2, 2, 100, 3) && reportIs(7, 2, OrderStatus::Filled, 100, 3, 0) &&
+                  reportIs(8, 10, OrderStatus::PartiallyFilled, 100, 3, 5));
+        TOB_CHECK(tradeIs(9, 3, 3, 101, 4) && reportIs(10, 3, OrderStatus::Filled, 101, 4, 0) &&
+                  reportIs(11, 10, OrderStatus::PartiallyFilled, 101, 4, 1));
+        TOB_CHECK(reportIs(12, 10, OrderStatus::Canceled, 101, 0, 1));
+    }
+    TOB_CHECK(ring->sink().overrun() == 0 && ring->sink().size() == 0);
+
+    std::vector<uint64_t> seqNums;
+    small->sink().drain([&](const BrokerEvent& event) {
+        seqNums.push_back((event.type_ == EventType::Trade) ? event.trade_.seqNum_ : event.report_.seqNum_);
+    });
+    TOB_CHECK(small->sink().overrun() == 9 && seqNums == std::vector<uint64_t>({10, 11, 12, 13}));
+
+    insertAll(makeOrder(11, QuoteType::Sell, OrderType::Limit, 99, 1));
+    TOB_CHECK(bookIs(bookOf(*null), {}, {{99, 1}}) && bookIs(bookOf(*ring), {}, {{99, 1}}));
+}
+
+// rejects every coid divisible by kEvery
+template <uint64_t kEvery>
+struct EveryNthRisk {
+    bool check(const Order& order) { return order.coid_ % kEvery; }
+};
+
+// keeps what reaches the publish stage
+struct RecordingPublisher {
+    std::vector<BrokerEvent> events_;
+
+    void onEvent(const BrokerEvent& event) { events_.push_back(event); }
+    template <size_t N>
+    void onBookDelta(const OrderbookDelta<N>&) {}
+};
+
+// pipeline: an order rejected by the risk stage is reported by the broker in its place among the events of the
+// orders around it, sequence numbers run without a gap
+void checkPipeline() {
+    using PipelineT = Pipeline<BrokerT<MapBook, EventRing<1 << 14>>, EveryNthRisk<3>, RecordingPublisher>;
+    auto pipeline = std::make_unique<PipelineT>(PipelineConfig());
+    auto submit = [&](uint64_t coid, QuoteType side, Price price, Qty qty) {
+        InsertOrder message;
+        message.coid_ = coid;
+        message.side_ = side;
+        message.price_ = price;
+        message.qty_ = qty;
+        message.type_ = OrderType::Limit;
+        message.tif_ = TimeInForce::GTC;
+        pipeline->submit(message);
+    };
+    submit(1, QuoteType::Sell, 100, 2);
+    submit(2, QuoteType::Sell, 101, 2);
+    submit(3, QuoteType::Buy, 101, 3);
+    submit(4, QuoteType::Buy, 101, 5);
+    submit(6, QuoteType::Sell, 99, 1);
+    submit(7, QuoteType::Sell, 99, 1);
+    pipeline->stop();
+
+    const std::vector<BrokerEvent>& eventsRef = pipeline->publisher().events_;
+    auto reportIs = [&](size_t i, uint64_t coid, OrderStatus status) {
+        return i < eventsRef.size() && eventsRef[i].type_ == EventType::ExecReport &&
+               eventsRef[i].report_.coid_ == coid && eventsRef[i].report_.status_ == status;
+    };
+    auto tradeIs = [&](size_t i, uint64_t bid, uint64_t ask) {
+        return i < eventsRef.size() && eventsRef[i].type_ == EventType::Trade &&
+               eventsRef[i].trade_.bidOrderId_ == bid && eventsRef[i].trade_.askOrderId_ == ask;
+    };
+    // 4 takes the 4 lots of 1 and 2 and rests 1 which 7 fills
+    TOB_CHECK(eventsRef.size() == 13);
+    TOB_CHECK(reportIs(0, 1, OrderStatus::New) && reportIs(1, 2, OrderStatus::New) &&
+              reportIs(2, 3, OrderStatus::Rejected) && tradeIs(3, 4, 1) && tradeIs(6, 4, 2) &&
+              reportIs(9, 6, OrderStatus::Rejected) && tradeIs(10, 4, 7) && reportIs(11, 4, OrderStatus::Filled));
+    for (size_t i = 0; i < eventsRef.size(); i++) {
+        const uint64_t constSeqNum = (eventsRef[i].type_ == EventType::Trade) ? eventsRef[i].trade_.seqNum_
+                                                                               : eventsRef[i].report_.seqNum_;
+        TOB_CHECK(constSeqNum == i + 1);
+    }
+}
+
+int32_t runChecks() {
+    checkLadder();
+    checkBTree();
+    checkCoids();
+    checkAmend();
+    checkFillOrKill();
+    checkProtection();
+    checkRisk();
+    checkOrderIndex();
+    checkTopLevels<MapBook>();
+    checkTopLevels<LadderBook<64>>();
+    checkTopLevels<BTreeBook<4>>();
+    checkBatches();
+    checkEvents();
+    checkPipeline();
+    std::cout << (checkFailures ? "checks FAILED" : "checks passed") << std::endl;
+    return checkFailures ? -1 : 0;
+}
+
+int32_t main(int32_t argc, char* argv[]) {
+    const std::string_view constMode = (argc > 1) ? argv[1] : "";
+    if (constMode == "convert" && (argc == 4 || argc == 6)) {
+        const TickScale constTickScale =
+            (argc == 6) ? TickScale(std::stoll(argv[4]), std::stoll(argv[5])) : TickScale();
+        std::cout << convertCsvToReplay(argv[2], argv[3], constTickScale) << " records written" << std::endl;
+        return 0;
+    }
+    if (constMode == "replay" && (argc == 3 || argc == 4)) {
+        if (argc == 4 && std::string_view(argv[3]) != "recorded") {
+            usage();
+            return -1;
+        }
+        TscClock::getInstance().calibrate();
+        runReplay<BrokerT<LadderBook<1 << 16>>>(argv[2], (argc == 4) ? ReplayPace::Recorded : ReplayPace::AsFastAsPossible);
+        return 0;
+    }
+    if (constMode == "csvbench" && (argc == 3 || argc == 4)) {
+        TscClock::getInstance().calibrate();
+        benchCsv(argv[2], (argc == 4) ? std::stoull(argv[3]) : 2048);
+        return 0;
+    }
+    if (constMode == "latency" && argc == 7) {
+        TscClock::getInstance().calibrate();
+        OrderFlowConfig config;
+        config.cancelRatio_ = std::stod(argv[3]);
+        config.marketRatio_ = std::stod(argv[4]);
+        config.aggressiveRatio_ = std::stod(argv[5]);
+        config.depthTicks_ = std::stoul(argv[6]);
+        const uint32_t constCount = std::stoul(argv[2]);
+        benchLatencySuite("configured flow", config, constCount / 4, constCount);
+        return 0;
+    }
+    if (constMode == "reset" && argc == 3) {
+        TscClock::getInstance().calibrate();
+        benchResetSuite(std::stoul(argv[2]));
+        return 0;
+    }
+    if (constMode == "warmup" && argc == 3) {
+        TscClock::getInstance().calibrate();
+        benchWarmup(std::stoul(argv[2]));
+        return 0;
+    }
+    if (constMode == "metrics" && argc == 3) {
+        TscClock::getInstance().calibrate();
+        benchMetrics(std::stoul(argv[2]));
+        return 0;
+    }
+    if (constMode == "hot" && argc == 3) {
+        TscClock::getInstance().calibrate();
+        benchHotOrder(std::stoul(argv[2]));
+        return 0;
+    }
+    if (constMode == "risk" && argc == 3) {
+        TscClock::getInstance().calibrate();
+        benchRisk(std::stoul(argv[2]));
+        return 0;
+    }
+    if (constMode == "check" && argc == 2) {
+        return runChecks();
+    }
+    if (constMode == "protect" && argc == 3) {
+        TscClock::getInstance().calibrate();
+        benchProtection(std::stoul(argv[2]));
+        return 0;
+    }
+    if (constMode == "perf" && argc == 3) {
+        benchPerfSuite(std::stoul(argv[2]));
+        return 0;
+    }
+    if (argc != 2) {
+        usage();
+        return -1;
+    }
+
+    TscClock& clock = TscClock::getInstance();
+    clock.calibrate();
+    std::cout << clock << std::endl;
+
+    const TickScale tickScale;
+    const int32_t constV = std::stoull(argv[1]);
+    benchBroker<BrokerT<MapBook>>("std::map + arena", constV, tickScale);
+    benchBroker<BrokerT<LadderBook<1 << 16>>>("price ladder", constV, tickScale);
+    benchBroker<BrokerT<BTreeBook<>>>("b+tree", constV, tickScale);
+
+    benchBatch<BrokerT<MapBook>>("std::map + arena", constV, tickScale);
+    benchBatch<BrokerT<LadderBook<1 << 16>>>("price ladder", constV, tickScale);
+    benchBatch<BrokerT<BTreeBook<>>>("b+tree", constV, tickScale);
+
+    benchRegistry<BrokerT<BTreeBook<>>>("b+tree registry", constV, tickScale);
+
+    benchPipeline<BrokerT<LadderBook<1 << 16>, EventRing<1 << 16>>>("price ladder", constV, tickScale);
+
+    benchSeqlock<BrokerT<LadderBook<1 << 16>>>("price ladder", constV, tickScale);
+
+    benchShmBus<BrokerT<LadderBook<1 << 16>, EventRing<1 << 16>>>("price ladder", constV, tickScale);
+
+    OrderFlowConfig flowConfig;
+    flowConfig.mid_ = tickScale.toTicks(150);
+    benchLatencySuite("default flow", flowConfig, constV / 4, constV);
+    flowConfig.cancelRatio_ = 0.2;
+    flowConfig.marketRatio_ = 0.1;
+    flowConfig.aggressiveRatio_ = 0.2;
+    flowConfig.depthTicks_ = 1000;
+    flowConfig.meanOffsetTicks_ = 100;
+    benchLatencySuite("aggressive deep flow", flowConfig, constV / 4, constV);
+
     return 0;
 }
 
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+#include <cstdint>
+#include "util.h"
+
+// pin the calling thread to a single core, a negative core leaves it unpinned
+inline bool pinCurrentThread(int32_t core) {
+    if (core < 0) {
+        return true;
+    }
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(core, &cpuSet);
+    return !pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+}
+
+// cores the calling thread may run on, e.g. to restore them with setCurrentAffinity after pinCurrentThread
+inline cpu_set_t currentAffinity() {
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    pthread_getaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+    return cpuSet;
+}
+
+inline bool setCurrentAffinity(const cpu_set_t &cpuSet) {
+    return !pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+}
+
+// busy polling backoff, keeps the core but frees pipeline resources for the sibling hyperthread
+ForceInline void cpuRelax() { __builtin_ia32_pause(); }
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include "type.h"
+#include "util.h"
+
+// per-instrument fixed-point price description
+//  scale_: integer units per 1.0 of price, 10^decimals
+//  tickSize_: minimal price increment in those units
+// e.g. scale_ = 100, tickSize_ = 5 ==> tick is 0.05 and 12.35 is 247 ticks
+// matching works on ticks only, conversion is done at the edges (gateway, display)
+struct TickScale {
+    int64_t scale_ = 100;
+    int64_t tickSize_ = 1;
+
+    constexpr TickScale() = default;
+    constexpr TickScale(int64_t scale, int64_t tickSize) : scale_(scale), tickSize_(tickSize) {}
+
+    ForceInline Price toTicks(double price) const {
+        return static_cast<Price>(std::llround(price * scale_ / tickSize_));
+    }
+    ForceInline double toDouble(Price ticks) const { return static_cast<double>(ticks * tickSize_) / scale_; }
+
+    // whether the price lies on the tick grid, rounding error of float input is tolerated
+    inline bool onTick(double price) const {
+        const double ticks = price * scale_ / tickSize_;
+        return std::fabs(ticks - std::nearbyint(ticks)) < 1e-6;
+    }
+};
+
+// bps basis points of price in whole ticks, rounded up: a band of bps > 0 spans at least one tick
+// whatever the price in ticks of the instrument
+ForceInline Price bandTicks(Price price, int64_t bps) {
+    if (bps <= 0) {
+        return 0;
+    }
+    const Price constTicks = ((price < 0 ? -price : price) * bps + 9999) / 10000;
+    return constTicks ? constTicks : 1;
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include "bookSide.h"
+#include "levelQueue.h"
+#include "message.h"
+#include "util.h"
+
+// best kDepth levels of one side, maintained from the level changes reported by the broker
+// instead of walking the book for every snapshot.
+//  complete_: the cache holds the best min(kDepth, book levels) levels,
+//      false after a cached level was removed from a full cache, levels beyond it are
+//      then loaded from the book by refill() the next time the cache is read
+//  dirty_: ranks changed since the last drainDirty()
+//  version_: counts the changes, lets several consumers tell whether the levels changed since they last looked
+template <QuoteType kSide, uint32_t kDepth>
+struct TopLevels {
+    using TraitsT = SideTraits<kSide>;
+    static_assert(kDepth > 0 && kDepth <= 64, "dirty ranks are tracked in a 64 bits mask");
+    static constexpr uint64_t skAllRanks = (kDepth == 64) ? ~0ull : ((1ull << kDepth) - 1);
+
+    ForceInline uint32_t size() const { return size_; }
+    ForceInline const PriceLevel &level(uint32_t rank) const { return levels_[rank]; }
+    ForceInline uint64_t dirty() const { return dirty_; }
+    ForceInline uint64_t version() const { return version_; }
+
+    // level at price now has qty, 0 qty means the level is gone
+    HintHot void onLevel(Price price, Qty qty) {
+        uint32_t rank = 0;
+        while (rank < size_ && TraitsT::better(levels_[rank].price_, price)) {
+            rank++;
+        }
+
+        if (rank < size_ && levels_[rank].price_ == price) [[likely]] {
+            if (qty) {
+                levels_[rank].qty_ = qty;
+                dirty_ |= (1ull << rank);
+                ++version_;
+            } else {
+                std::copy(levels_ + rank + 1, levels_ + size_, levels_ + rank);
+                complete_ = complete_ && (size_ < kDepth);
+                --size_;
+                dirty_ |= (skAllRanks << rank) & skAllRanks;
+                ++version_;
+            }
+            return;
+        }
+
+        // a new level, beyond the cache when it is full or incomplete
+        if (!qty || rank == kDepth || (rank == size_ && !complete_)) {
+            return;
+        }
+        const uint32_t constLast = (size_ < kDepth) ? size_ : kDepth - 1;
+        std::copy_backward(levels_ + rank, levels_ + constLast, levels_ + constLast + 1);
+        levels_[rank].price_ = price;
+        levels_[rank].qty_ = qty;
+        size_ = constLast + 1;
+        dirty_ |= (skAllRanks << rank) & skAllRanks;
+        ++version_;
+    }
+
+    // load levels missing at the end of an incomplete cache
+    template <class SideT>
+    void refill(const SideT &side) {
+        if (complete_) [[likely]] {
+            return;
+        }
+
+        uint32_t rank = 0;
+        side.forEach([&](Price price, const LevelQueue *level) {
+            if (rank >= size_) {
+                levels_[rank].price_ = price;
+                levels_[rank].qty_ = level->qty_;
+                dirty_ |= (1ull << rank);
+                ++version_;
+            }
+            return ++rank < kDepth;
+        });
+        size_ = rank;
+        complete_ = true;
+    }
+
+    // reload the whole cache from the book, only ranks which differ are marked dirty
+    template <class SideT>
+    void rebuild(const SideT &side) {
+        uint32_t rank = 0;
+        side.forEach([&](Price price, const LevelQueue *level) {
+            PriceLevel &levelRef = levels_[rank];
+            if (rank >= size_ || levelRef.price_ != price || levelRef.qty_ != level->qty_) {
+                levelRef.price_ = price;
+                levelRef.qty_ = level->qty_;
+                dirty_ |= (1ull << rank);
+                ++version_;
+            }
+            return ++rank < kDepth;
+        });
+        if (rank < size_) {
+            dirty_ |= (skAllRanks << rank) & skAllRanks;
+            ++version_;
+        }
+        size_ = rank;
+        complete_ = true;
+    }
+
+    ForceInline uint32_t copyTo(PriceLevel *levels, uint32_t depth) const {
+        const uint32_t constSize = std::min(depth, size_);
+        std::copy(levels_, levels_ + constSize, levels);
+        return constSize;
+    }
+
+    // visit ranks changed since the last call, fn(rank, const PriceLevel &), ranks beyond size() are skipped
+    template <class F>
+    void drainDirty(F &&fn) {
+        uint64_t dirty = dirty_ & ((size_ == 64) ? ~0ull : ((1ull << size_) - 1));
+        while (dirty) {
+            const uint32_t rank = std::countr_zero(dirty);
+            fn(rank, levels_[rank]);
+            dirty &= dirty - 1;
+        }
+        dirty_ = 0;
+    }
+
+   private:
+    PriceLevel levels_[kDepth];
+    uint32_t size_ = 0;
+    bool complete_ = true;
+    uint64_t dirty_ = 0;
+    uint64_t version_ = 0;
+};
@@ -49,6 +49,7 @@ struct TscClock {
 
     inline double tsc2Sec(uint64_t tsc) const { return tsc * secPerTick_; }
     inline uint64_t tsc2Ns(uint64_t tsc) const { return static_cast<uint64_t>(tsc * nsPerTick_); }
+    inline uint64_t ns2Tsc(uint64_t ns) const { return static_cast<uint64_t>(ns * ticksPerNs_); }
 
     void delayCycles(uint64_t cycles) {
         const uint64_t endTick = rdTsc() + cycles;
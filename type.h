@@ -3,7 +3,9 @@
 #include <cstdint>
 #include <string_view>
 
-using Price = float;
+// price is an integer number of ticks, see TickScale in tickScale.h
+// for the per-instrument conversion from/to float at the edges
+using Price = int64_t;
 constexpr Price INVALID_PRICE = 0;
 using Qty = int32_t;
 constexpr Qty INVALID_QTY = 0;